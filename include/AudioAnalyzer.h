@@ -0,0 +1,117 @@
+﻿#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BufferPool.h"
+
+namespace AudioEnc {
+
+	// 品質チェックの判定基準
+	struct AnalyzerSettings {
+		float clip_level = 0.999f;      // |x| がこの値以上ならクリップとみなす
+		int silence_db = -60;           // 無音とみなすレベル (dBFS)
+		int silence_min_ms = 2000;      // 報告する無音区間の最小長
+		int corr_window_ms = 1000;      // L/R 相関を求める区間長
+		double dc_limit = 0.01;         // 許容するDCオフセット (約 -40dBFS)
+		double corr_limit = -0.3;       // これを下回る相関区間はモノラル互換性なしとみなす
+		size_t max_clip_positions = 64; // レポートに記録するクリップ位置の上限 (チャンネル毎)
+	};
+
+	struct ChannelStats {
+		float peak = 0.0f;
+		uint64_t clip_count = 0;
+		std::vector<int64_t> clip_positions;
+		double sum = 0.0;
+		double dc_offset = 0.0;
+	};
+
+	struct SampleRange {
+		int64_t start = 0;  // 開始サンプル
+		int64_t end = 0;    // 終了サンプル (この位置を含まない)
+	};
+
+	struct CorrelationPoint {
+		int64_t start = 0;
+		float corr = 0.0f;
+	};
+
+	struct AnalyzerReport {
+		int rate = 0;
+		int channels = 0;
+		int64_t frames = 0;
+		std::vector<ChannelStats> ch;
+		std::vector<SampleRange> silences;
+		std::vector<CorrelationPoint> correlation;
+		float min_corr = 1.0f;
+		float mean_corr = 1.0f;
+	};
+
+	/// <summary>
+	/// 出力中の音声をワーカースレッドで解析する
+	/// </summary>
+	/// <description>
+	/// Push() はバッファをプールから借りたバッファにコピーしてキューに積むだけなので、エンコード側の処理はほぼ待たされない。
+	/// 解析が追いつかない場合は出力の予算を使い切った時点で Push() が待つ。
+	/// 解析はピーク・クリップ・DCオフセット・無音区間・L/R相関を1パスで求める。
+	/// </description>
+	class AudioAnalyzer {
+	public:
+		AudioAnalyzer(int rate, int channels, const AnalyzerSettings& settings, ExportBudget& budget);
+		~AudioAnalyzer();
+
+		AudioAnalyzer(const AudioAnalyzer&) = delete;
+		AudioAnalyzer& operator=(const AudioAnalyzer&) = delete;
+
+		// frames サンプル分 (インターリーブ) をコピーして解析キューに積む
+		void Push(const float* data, int frames);
+
+		// 残りのキューを処理し終えるまで待ってから結果を返す
+		AnalyzerReport Finish();
+
+	private:
+		void WorkerMain();
+		void Process(const float* data, int frames);
+		void ProcessPeaks(const float* data, int frames);
+		void ProcessFrames(const float* data, int frames);
+		void RecordClip(size_t sample);
+		void CloseSilence(int64_t end);
+		void CloseCorrWindow(int64_t next_start);
+
+		AnalyzerSettings settings_;
+		AnalyzerReport report_;
+		float silence_level_ = 0.0f;
+		int64_t silence_min_frames_ = 0;
+		int64_t corr_window_frames_ = 0;
+
+		int64_t pos_ = 0;
+		int64_t silence_start_ = -1;
+		int64_t corr_start_ = 0;
+		int64_t corr_count_ = 0;
+		double corr_ll_ = 0.0, corr_rr_ = 0.0, corr_lr_ = 0.0;
+		double corr_sum_ = 0.0;
+		int64_t corr_n_ = 0;
+
+		struct Chunk {
+			PooledBuffer buf;
+			int frames = 0;
+		};
+		ExportBudget& budget_;
+		std::deque<Chunk> queue_;
+		std::mutex mutex_;
+		std::condition_variable cv_;
+		bool closed_ = false;
+		std::thread worker_;
+	};
+
+	// 判定基準を超えた項目をメッセージとして列挙する (空なら合格)
+	std::vector<std::wstring> FindViolations(const AnalyzerReport& report, const AnalyzerSettings& settings);
+
+	// 解析結果をJSONで書き出す
+	bool WriteReportJson(const std::filesystem::path& path, const AnalyzerReport& report, const std::vector<std::wstring>& violations);
+}
@@ -0,0 +1,151 @@
+﻿#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace AudioEnc {
+
+	class BufferPool;
+	class ExportBudget;
+
+	struct PoolStats {
+		uint64_t acquires = 0;        // Acquire() の回数
+		uint64_t allocations = 0;     // OS から新しくスラブを確保した回数
+		uint64_t reuses = 0;          // 空きスラブを再利用した回数
+		uint64_t waits = 0;           // 予算超過で待たされた回数
+		uint64_t overflows = 0;       // 予算を空けられるのが自分だけのため予算外で確保した回数
+		size_t bytes_in_use = 0;
+		size_t peak_in_use = 0;
+		size_t bytes_reserved = 0;    // 空きスラブを含めて OS から確保している量
+		size_t peak_reserved = 0;
+		bool large_pages = false;
+	};
+
+	/// <summary>
+	/// プールから借りたバッファ。破棄するとプールへ返る
+	/// </summary>
+	class PooledBuffer {
+	public:
+		PooledBuffer() = default;
+		PooledBuffer(PooledBuffer&& o) noexcept { *this = std::move(o); }
+		PooledBuffer& operator=(PooledBuffer&& o) noexcept;
+		~PooledBuffer() { Release(); }
+
+		PooledBuffer(const PooledBuffer&) = delete;
+		PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+		void* Data() const { return data_; }
+		size_t Size() const { return size_; }
+		size_t Capacity() const { return capacity_; }
+		template <class T> T* As() const { return static_cast<T*>(data_); }
+		explicit operator bool() const { return data_ != nullptr; }
+
+		void Release();
+
+		// 以後は別のスレッドが返却することを示す (キューで渡す場合など)。
+		// 借りたスレッドの保持分から外れるので、そのスレッドが予算待ちで止まる理由にならない
+		void HandOff();
+
+	private:
+		friend class ExportBudget;
+		friend class BufferPool;
+		ExportBudget* owner_ = nullptr;
+		void* data_ = nullptr;
+		size_t size_ = 0;
+		size_t capacity_ = 0;
+		int cls_ = 0;                   // -1 は予算外の確保
+		bool carved_ = false;           // ブロックから切り出したスラブ (OS に返さない)
+		std::thread::id holder_;        // 返却する予定のスレッド (HandOff 後は空)
+	};
+
+	/// <summary>
+	/// 出力1回分のメモリ予算
+	/// </summary>
+	/// <description>
+	/// Acquire() は予算 (この出力の分と、プール全体の分) を超える場合、他のバッファが返却されるまで待つ。
+	/// ただし予算を使っているのが呼び出したスレッド自身の持つバッファだけなら、待っても返ってこないので
+	/// 待たずに予算外で確保する。バッファを使い切る前に破棄しないこと。
+	/// </description>
+	class ExportBudget {
+	public:
+		ExportBudget(BufferPool& pool, size_t limit) : pool_(pool), limit_(limit) {}
+
+		ExportBudget(const ExportBudget&) = delete;
+		ExportBudget& operator=(const ExportBudget&) = delete;
+
+		PooledBuffer Acquire(size_t bytes);
+
+		size_t PeakInUse() const { return peak_in_use_; }
+		uint64_t Acquires() const { return acquires_; }
+		uint64_t Waits() const { return waits_; }
+		uint64_t Overflows() const { return overflows_; }
+
+	private:
+		friend class BufferPool;
+		friend class PooledBuffer;
+		void Return(PooledBuffer& buf);
+
+		BufferPool& pool_;
+		size_t limit_;
+		size_t in_use_ = 0;
+		size_t peak_in_use_ = 0;
+		uint64_t acquires_ = 0;
+		uint64_t waits_ = 0;
+		uint64_t overflows_ = 0;
+		std::map<std::thread::id, size_t> held_;    // スレッド毎の使用量 (プールのロックで保護)
+	};
+
+	/// <summary>
+	/// 出力パイプライン用のバッファプール
+	/// </summary>
+	/// <description>
+	/// 4KB から 2 の累乗のサイズクラスでスラブを VirtualAlloc し (ページ境界、したがってキャッシュライン境界に揃う)、
+	/// 返却されたスラブは出力をまたいで再利用する。空きスラブを含めた確保量がプール全体の予算を超えたら空きから解放する。
+	/// 64KB (ラージページ使用時はラージページ1枚) より小さいクラスは、そのブロックから切り出して確保粒度の無駄と
+	/// TLB の消費を抑える。切り出したスラブは解放せずに持ち続け、解放の判定にも数えない
+	/// (ブロックはクラス毎に高々数個なので、その分はプール全体の予算の下限として確保しておく)。
+	/// </description>
+	class BufferPool {
+	public:
+		static BufferPool& Instance();
+
+		// global_limit: プール全体の予算 (切り出し用ブロックの最大量を下回る場合は引き上げる)
+		// large_pages: 可能ならラージページを使う
+		void Configure(size_t global_limit, bool large_pages);
+
+		PoolStats Stats() const;
+
+		// 空きスラブをすべて OS に返す
+		void Trim();
+
+	private:
+		friend class ExportBudget;
+		friend class PooledBuffer;
+		static constexpr int kMinShift = 12;    // 4KB
+		static constexpr int kClasses = 17;     // 4KB .. 256MB
+
+		void* Acquire(ExportBudget& budget, size_t bytes, int& cls, bool& carved);
+		void Return(ExportBudget& budget, PooledBuffer& buf);
+		void HandOff(ExportBudget& budget, PooledBuffer& buf);
+		void* NewSlabLocked(int cls, bool& carved);
+		void* AllocateSlab(size_t bytes, bool pooled);
+		void FreeSlab(void* data);
+		void TrimLocked(size_t target);
+
+		mutable std::mutex mutex_;
+		std::condition_variable cv_;
+		std::vector<void*> free_[kClasses];         // 解放できる空きスラブ
+		std::vector<void*> carved_free_[kClasses];  // ブロックから切り出した空きスラブ
+		std::map<std::thread::id, size_t> held_;    // スレッド毎の使用量 (全出力の合計)
+		size_t carved_bytes_ = 0;                   // 切り出し用ブロックの合計 (bytes_reserved の内数)
+		size_t global_limit_ = (size_t)256 << 20;
+		bool use_large_pages_ = false;
+		size_t large_page_size_ = 0;
+		PoolStats stats_;
+	};
+}
@@ -0,0 +1,57 @@
+﻿#pragma once
+#include <windows.h>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace AudioEnc {
+
+	/// <summary>
+	/// 標準入力をパイプにした ffmpeg プロセス
+	/// </summary>
+	/// <description>
+	/// CloseInput() で入力を閉じた後はエンコーダがバックグラウンドで残りを処理するので、
+	/// Wait() を呼ぶまで次のエンコーダと並行して動かせる。
+	/// </description>
+	class EncoderProcess {
+	public:
+		EncoderProcess() = default;
+		~EncoderProcess();
+
+		EncoderProcess(const EncoderProcess&) = delete;
+		EncoderProcess& operator=(const EncoderProcess&) = delete;
+
+		// showWindow: ffmpeg のコンソールを表示する (較正用など裏で動かす場合は false)
+		bool Start(std::wstring cmdline, bool showWindow = true);
+
+		// ffmpeg 側が終了していて書き込めなければ false
+		bool Write(const void* data, size_t bytes);
+
+		void CloseInput();
+
+		// 終了を待って終了コードを返す
+		DWORD Wait();
+
+		void Terminate();
+
+		bool Running() const { return process_ != NULL; }
+		bool Broken() const { return broken_; }
+		uint64_t BytesWritten() const { return bytes_written_; }
+
+		// Write() の中で待たされた時間の合計 (エンコーダが追いついていない目安)
+		double WriteSeconds() const { return write_seconds_; }
+
+		// 起動から終了までの時間 (終了前なら現在まで)
+		double Seconds() const;
+
+	private:
+		HANDLE process_ = NULL;
+		HANDLE thread_ = NULL;
+		HANDLE pipe_ = NULL;
+		bool broken_ = false;
+		uint64_t bytes_written_ = 0;
+		double write_seconds_ = 0.0;
+		std::chrono::steady_clock::time_point start_{};
+		std::chrono::steady_clock::time_point end_{};
+	};
+}
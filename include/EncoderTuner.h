@@ -0,0 +1,74 @@
+﻿#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace AudioEnc {
+
+	// 自動調整の対象となるコーデック
+	struct TuneTarget {
+		std::wstring key;           // プロファイルのキー ("flac", "mp3192k_" など)
+		std::wstring name;          // ログ表示用
+		std::vector<int> levels;    // 速い (弱い) 設定から強い設定の順
+	};
+
+	// 較正エンコードに使う先頭部分の音声
+	struct CalibrationData {
+		std::vector<std::pair<const void*, size_t>> chunks;  // (インターリーブのデータ, バイト数)
+		std::string input_args;                             // ffmpeg の入力指定 (FfmpegInputArgs)
+		int64_t frames = 0;
+		int rate = 0;
+		int channels = 0;
+		int out_rate = 0;
+	};
+
+	/// <summary>
+	/// 描画速度に追いつける範囲で最も強いエンコード設定を選ぶ
+	/// </summary>
+	/// <description>
+	/// 各設定のエンコード速度 (サンプル/秒) は .ini の [AutoTune] にマシン毎のプロファイルとして保存し、
+	/// 未計測の設定だけ先頭部分を ffmpeg で較正エンコードして測る。ffmpeg の起動時間は
+	/// PCM をそのまま流した場合の時間を差し引いて除く。
+	/// 出力中に観測した速度は指数移動平均でプロファイルに混ぜ、一時的な負荷で値が下がったままにならないようにする。
+	/// </description>
+	class EncoderTuner {
+	public:
+		// 描画速度に対してこの倍率以上速い設定だけを選ぶ
+		static constexpr double kMargin = 1.25;
+		// 観測した速度をプロファイルに混ぜる割合
+		static constexpr double kBlend = 0.25;
+
+		using CodecArgsFunc = std::function<std::string(int level)>;
+
+		EncoderTuner(TuneTarget target, std::filesystem::path profile, int rate, int channels, int out_rate);
+
+		const TuneTarget& Target() const { return target_; }
+
+		// 計測済みのエンコード速度 (未計測なら 0)
+		double Throughput(int level) const;
+		void SetThroughput(int level, double fps);
+
+		// 強い設定から順に速度を確かめ、render_fps に追いつける最初の設定を返す
+		int Choose(double render_fps, const CalibrationData& data, const CodecArgsFunc& codecArgs);
+
+		// 出力中に観測した値でプロファイルを補正し、選び直した設定を返す
+		// encoder_bound: エンコーダへの書き込みで待たされていた (エンコーダが律速だった)
+		int Reevaluate(int level, double render_fps, double encoder_fps, bool encoder_bound);
+
+	private:
+		std::wstring ProfileKey(const std::wstring& codec) const;
+		double Calibrate(const CalibrationData& data, const std::string& codecArgs) const;
+		double StartupSeconds(const CalibrationData& data);
+		int Pick(double render_fps) const;
+
+		TuneTarget target_;
+		std::filesystem::path profile_;
+		int rate_;
+		int channels_;
+		int out_rate_;
+		double startup_ = -1.0;
+	};
+}
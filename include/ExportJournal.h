@@ -0,0 +1,50 @@
+﻿#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace AudioEnc {
+
+	/// <summary>
+	/// 出力1回分のジャーナルの記録
+	/// </summary>
+	struct JournalRecord {
+		std::string version;                                      // プラグインのバージョン表記
+		std::filesystem::path file;
+		std::string format;                                       // 拡張子 (".flac" など)
+		std::string preset;
+		std::vector<std::pair<std::string, int64_t>> settings;    // AudioConfig の数値の設定
+		std::string fetch;                                        // ホストから受け取った形式
+		int audio_rate = 0;
+		int audio_ch = 0;
+		int64_t audio_n = 0;
+		double wall_seconds = 0.0;
+		std::vector<std::pair<std::string, double>> stages;       // 段階毎の所要時間 (秒)
+		uint64_t pipe_bytes = 0;                                  // ffmpeg に流した量
+		uint64_t output_bytes = 0;                                // 出力ファイルの合計サイズ
+		int tracks = 0;
+		int64_t exit_code = -1;                                   // ffmpeg の終了コード (複数あれば最初の異常値, 起動していなければ -1)
+		bool aborted = false;
+		bool ok = false;
+		std::string error;
+	};
+
+	// 段階毎の所要時間を足し込む
+	void AddStage(JournalRecord& rec, const std::string& name, double seconds);
+
+	// JSON の1行 (改行を含まない) にする
+	std::string FormatJournalLine(const JournalRecord& rec);
+
+	/// <summary>
+	/// ジャーナル (JSON Lines) に1行追記する
+	/// </summary>
+	/// <description>
+	/// 1回の WriteFile で書いて FlushFileBuffers するので、途中で落ちても壊れるのは最後の1行だけになる。
+	/// 前回の書き込みが途中で切れていた (末尾が改行でない) 場合は改行を補ってから書く。
+	/// max_bytes を超える場合は path.1, path.2, ... と世代をずらし、keep 世代より古いものは消す。
+	/// 同じ path に書く他のプロセスとは名前付きミューテックスで排他する。
+	/// </description>
+	bool AppendJournal(const std::filesystem::path& path, const JournalRecord& rec, uint64_t max_bytes, int keep);
+}
@@ -0,0 +1,92 @@
+﻿#pragma once
+#include <complex>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace AudioEnc {
+
+	/// <summary>
+	/// モノラルにまとめた音声のブロック毎の帯域エネルギー (dB) を求める
+	/// </summary>
+	/// <description>
+	/// 非可逆形式の検証用。ブロック長 kBlock の Hann 窓付き FFT から kBands 個の帯域エネルギーを取り出す。
+	/// </description>
+	class SpectralFingerprint {
+	public:
+		static constexpr int kBlock = 1024;
+		static constexpr int kBands = 7;
+
+		SpectralFingerprint(int rate, int channels);
+		void Update(const float* data, int frames);
+		const std::vector<float>& Bands() const { return bands_; }
+
+	private:
+		void Flush();
+
+		int channels_;
+		std::vector<float> window_;
+		std::vector<std::complex<float>> twiddle_;
+		std::vector<std::complex<float>> work_;
+		int band_bin_[kBands + 1]{};
+		std::vector<float> block_;
+		std::vector<float> bands_;
+	};
+
+	/// <summary>
+	/// 出力中の PCM から検証用のダイジェストを求める
+	/// </summary>
+	/// <description>
+	/// ffmpeg と同じ丸め (最近接偶数丸め・飽和) で 16/24/32bit に量子化した値のハッシュを同時に持つので、
+	/// 可逆形式は出力ファイルがどのビット深度で書かれていても完全一致を確認できる。
+	/// </description>
+	class PcmDigest {
+	public:
+		PcmDigest(int rate, int channels, bool fingerprint);
+
+		void Update(const float* data, int frames);
+
+		// bits: 16 / 24 / 32 (それ以外は 0)
+		uint64_t Hash(int bits) const;
+		int64_t Frames() const { return frames_; }
+		int Rate() const { return rate_; }
+		int Channels() const { return channels_; }
+		const SpectralFingerprint* Fingerprint() const { return fingerprint_.get(); }
+
+	private:
+		int rate_;
+		int channels_;
+		int64_t frames_ = 0;
+		uint64_t h16_, h24_, h32_;
+		std::unique_ptr<SpectralFingerprint> fingerprint_;
+	};
+
+	struct VerifyJob {
+		std::filesystem::path file;
+		std::string ext;                    // 小文字の拡張子 (".wav" など)
+		bool exact = false;                 // 可逆形式かつリサンプルなしならハッシュで完全一致を確認する
+		std::shared_ptr<PcmDigest> digest;
+		double encode_seconds = 0.0;        // ベンチマーク表示用
+		double max_spectral_error_db = 3.0; // 非可逆形式で許容する帯域エネルギーの平均誤差
+	};
+
+	struct VerifyResult {
+		bool ok = false;
+		std::wstring message;
+		double seconds = 0.0;
+		uint64_t bytes_decoded = 0;
+	};
+
+	// 出力ファイルをデコードしてダイジェストと比較する (呼び出したスレッドで実行)
+	VerifyResult VerifyOutput(const VerifyJob& job);
+
+	// VerifyOutput をバックグラウンドで実行し、完了時に done を呼ぶ
+	// 検証は1本のワーカースレッドで登録順に1件ずつ実行する
+	void StartBackgroundVerify(VerifyJob job, std::function<void(const VerifyJob&, const VerifyResult&)> done);
+
+	// 実行中のバックグラウンド検証がすべて終わるまで待ち、そのスレッドを join する
+	void WaitBackgroundVerify();
+}
@@ -0,0 +1,40 @@
+﻿#pragma once
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+namespace AudioEnc {
+
+	// レポート類をJSONで書き出すための小さなヘルパー (ロケールに依存しない)
+
+	inline void AppendJsonNumber(std::string& s, double v) {
+		char buf[32];
+		auto r = std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::general, 6);
+		s.append(buf, r.ptr);
+	}
+
+	inline void AppendJsonNumber(std::string& s, int64_t v) {
+		s += std::to_string(v);
+	}
+
+	inline void AppendJsonString(std::string& s, const std::string& v) {
+		s += '"';
+		for (char c : v) {
+			if (c == '"' || c == '\\') { s += '\\'; s += c; }
+			else if ((unsigned char)c < 0x20) {
+				char buf[8];
+				snprintf(buf, sizeof(buf), "\\u%04x", c);
+				s += buf;
+			}
+			else s += c;
+		}
+		s += '"';
+	}
+
+	inline std::string PathToUtf8(const std::filesystem::path& p) {
+		auto u8 = p.u8string();
+		return std::string(u8.begin(), u8.end());
+	}
+}
@@ -0,0 +1,65 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace AudioEnc {
+
+	// ホスト (func_get_audio) から受け取るサンプル形式
+	enum class FetchFormat {
+		Float,      // WAVE_FORMAT_IEEE_FLOAT (32bit float)
+		Pcm16,      // WAVE_FORMAT_PCM (16bit)
+	};
+
+	inline int HostFormatId(FetchFormat f) { return f == FetchFormat::Pcm16 ? 1 : 3; }
+	inline int BytesPerSample(FetchFormat f) { return f == FetchFormat::Pcm16 ? 2 : 4; }
+	inline const wchar_t* FetchFormatName(FetchFormat f) { return f == FetchFormat::Pcm16 ? L"PCM16" : L"float"; }
+
+	/// <summary>
+	/// 出力先の形式に対して精度を落とさずに済む取得形式を選ぶ
+	/// </summary>
+	/// <description>
+	/// 16bit の WAV / FLAC は最終的に 16bit になるので PCM16 で受け取る。
+	/// 非可逆コーデック (MP3, Opus) は 0dBFS を超えた部分もそのまま符号化できるので、PCM16 で飽和させないよう float にする。
+	/// lossyPcm16 を指定した場合だけ、量子化雑音がコーデックの雑音に埋もれるとみなして PCM16 にする。
+	/// それ以外 (24bit 以上の可逆、Vorbis) は float のまま受け取る。
+	/// リサンプルする場合は、s16 入力だと ffmpeg が整数演算でリサンプルして 16bit に量子化し直すため、常に float にする。
+	/// </description>
+	/// <param name="bits">可逆形式の出力ビット深度 (非可逆形式では無視)</param>
+	/// <param name="in_rate">ホストのサンプルレート</param>
+	/// <param name="out_rate">出力のサンプルレート</param>
+	/// <param name="lossyPcm16">MP3 / Opus でも PCM16 で受け取る</param>
+	FetchFormat NegotiateFetchFormat(const std::string& ext, int bits, int in_rate, int out_rate, bool lossyPcm16);
+
+	// ffmpeg の入力指定 ("-f s16le -ar 48000 -ac 2" など)
+	std::string FfmpegInputArgs(FetchFormat f, int rate, int channels);
+
+	void Pcm16ToFloat(const int16_t* src, float* dst, size_t count);
+
+	// 四捨五入 (偶数丸め) して飽和させる
+	void FloatToPcm16(const float* src, int16_t* dst, size_t count);
+
+	struct FetchBenchResult {
+		int64_t frames = 0;
+		double fetch_seconds[2] = {};      // [float, PCM16] のホストからの取得時間
+		double encode_seconds[2] = {};     // [float, PCM16] のエンコード時間 (ffmpeg の起動を含む)
+		uint64_t bytes[2] = {};            // [float, PCM16] のパイプに流した量
+		double snr_db = 0.0;               // float 取得を基準にした PCM16 取得の S/N
+		double max_error = 0.0;            // 同、最大誤差 (フルスケール = 1)
+		uint64_t clipped = 0;              // float 取得で ±1 を超えていた (PCM16 では飽和する) サンプル数
+		bool ok = false;
+	};
+
+	using FetchFunc = std::function<const void*(int start, int length, int* readed, int format)>;
+
+	/// <summary>
+	/// 先頭 frames サンプルを両方の形式で取得し、取得・エンコードの速度と PCM16 にした場合の誤差を比べる
+	/// </summary>
+	/// <description>
+	/// ホストのキャッシュの影響を避けるため各形式を2回ずつ交互に取得して速い方を採る。
+	/// エンコードは codecArgs で出力を捨てる (-f null) ので、実際の出力と同じ設定の速度になる。
+	/// </description>
+	FetchBenchResult RunFetchBenchmark(const FetchFunc& fetch, int frames, int rate, int channels, int out_rate,
+		const std::string& codecArgs);
+}
@@ -0,0 +1,81 @@
+﻿#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "AudioAnalyzer.h"
+
+namespace AudioEnc {
+
+	struct TrackInfo {
+		std::filesystem::path file;
+		int64_t start = 0;  // 元の音声での開始サンプル
+		int64_t end = 0;    // 終了サンプル (この位置を含まない)
+	};
+
+	/// <summary>
+	/// 1回の出力パスの中で音声をトラックに振り分ける
+	/// </summary>
+	/// <description>
+	/// サンプル範囲の指定、または無音検出で区切る。どのサンプルもちょうど1つのトラックに渡るので、
+	/// 可逆形式ではトラックを連結すると元の音声と一致する (範囲指定で範囲外にしたサンプルを除く)。
+	/// 無音検出では min_gap 以上続いた無音の中で区切り、次のトラックの頭には最大 min_gap/2 の無音が残る。
+	/// </description>
+	class TrackSplitter {
+	public:
+		// track 番号のトラックに frames サンプル分を書き込む
+		using WriteFunc = std::function<void(int track, const float* data, int frames)>;
+		// track 番号のトラックがこれ以上データを受け取らないことを通知する
+		using EndFunc = std::function<void(int track)>;
+
+		static TrackSplitter FromRanges(int channels, std::vector<SampleRange> ranges);
+		static TrackSplitter FromSilence(int rate, int channels, int min_gap_ms, int silence_db);
+
+		void Feed(const float* data, int frames, const WriteFunc& write, const EndFunc& end);
+		void Finish(const WriteFunc& write, const EndFunc& end);
+
+		// 各トラックの元の音声での範囲 (Finish 後に確定)
+		const std::vector<SampleRange>& Tracks() const { return tracks_; }
+
+	private:
+		TrackSplitter(int channels) : channels_(channels) {}
+
+		void FeedRanges(const float* data, int frames, const WriteFunc& write, const EndFunc& end);
+		void FeedSilence(const float* data, int frames, const WriteFunc& write, const EndFunc& end);
+		void WriteTrack(const float* data, int frames, const WriteFunc& write);
+		void EndRun(const WriteFunc& write, const EndFunc& end);
+		void FlushHeld(int64_t frames, const WriteFunc& write);
+
+		int channels_;
+		int64_t pos_ = 0;
+		int64_t out_pos_ = 0;
+		int track_ = 0;
+		std::vector<SampleRange> tracks_;
+
+		// 範囲指定
+		bool by_ranges_ = false;
+		std::vector<SampleRange> ranges_;
+
+		// 無音検出
+		float silence_level_ = 0.0f;
+		int64_t min_gap_ = 0;
+		int64_t lead_ = 0;              // 次のトラックの頭に残す無音の長さ
+		int64_t run_ = 0;               // 現在続いている無音の長さ
+		bool track_has_audio_ = false;
+		std::vector<float> held_;       // 書き込みを保留している無音 (最大 lead_ * 2 サンプル程度)
+	};
+
+	// "開始-終了,開始-終了" 形式のサンプル範囲を解析する (終了を省略すると total まで)
+	std::vector<SampleRange> ParseSampleRanges(const std::wstring& text, int64_t total);
+
+	// 分割したトラックのファイル名 ("名前_01.flac" など)
+	std::filesystem::path TrackFilePath(const std::filesystem::path& savefile, int track);
+
+	// マルチファイル形式の .cue を書き出す
+	bool WriteCueSheet(const std::filesystem::path& path, const std::vector<TrackInfo>& tracks);
+
+	// トラックの一覧とサンプル範囲をJSONで書き出す
+	bool WriteTrackManifest(const std::filesystem::path& path, int rate, const std::vector<TrackInfo>& tracks);
+}
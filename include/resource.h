@@ -10,6 +10,17 @@
 #define EDIT_FLAC_LEVEL   1003
 #define EDIT_WAV_BITDEPTH 1005
 
+#define IDC_QC_ENABLE     1007
+#define IDC_QC_FAIL       1008
+#define IDC_VERIFY        1009
+
+#define IDC_SPLIT_MODE    1010
+#define IDC_SPLIT_RANGES  1011
+
+#define IDC_MP3_AUTO      1012
+#define IDC_OPUS_AUTO     1013
+#define IDC_FLAC_AUTO     1014
+
 #define IDC_PRESET_COMBO  2001
 #define IDC_SAVE_PRESET   2002
 
@@ -0,0 +1,309 @@
+﻿#define NOMINMAX
+#include <windows.h>
+#include <emmintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "AudioAnalyzer.h"
+#include "JsonText.h"
+
+namespace AudioEnc {
+
+	namespace {
+		std::string ToUtf8(const std::wstring& w) {
+			if (w.empty()) return {};
+			int size = WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(), nullptr, 0, nullptr, nullptr);
+			std::string s(size, '\0');
+			WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(), s.data(), size, nullptr, nullptr);
+			return s;
+		}
+
+		double ToDbfs(double v) {
+			return (v > 0.0) ? 20.0 * std::log10(v) : -200.0;
+		}
+	}
+
+	AudioAnalyzer::AudioAnalyzer(int rate, int channels, const AnalyzerSettings& settings, ExportBudget& budget)
+		: settings_(settings), budget_(budget) {
+		report_.rate = rate;
+		report_.channels = channels;
+		report_.ch.resize(channels);
+		silence_level_ = (float)std::pow(10.0, settings.silence_db / 20.0);
+		silence_min_frames_ = (int64_t)rate * settings.silence_min_ms / 1000;
+		corr_window_frames_ = std::max<int64_t>(1, (int64_t)rate * settings.corr_window_ms / 1000);
+		worker_ = std::thread(&AudioAnalyzer::WorkerMain, this);
+	}
+
+	AudioAnalyzer::~AudioAnalyzer() {
+		if (worker_.joinable()) {
+			{
+				std::lock_guard<std::mutex> lk(mutex_);
+				closed_ = true;
+			}
+			cv_.notify_all();
+			worker_.join();
+		}
+	}
+
+	void AudioAnalyzer::Push(const float* data, int frames) {
+		const size_t bytes = (size_t)frames * report_.channels * sizeof(float);
+		Chunk chunk;
+		chunk.buf = budget_.Acquire(bytes);
+		chunk.frames = frames;
+		memcpy(chunk.buf.Data(), data, bytes);
+		// 返却するのはワーカースレッド
+		chunk.buf.HandOff();
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			queue_.push_back(std::move(chunk));
+		}
+		cv_.notify_all();
+	}
+
+	AnalyzerReport AudioAnalyzer::Finish() {
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			closed_ = true;
+		}
+		cv_.notify_all();
+		if (worker_.joinable()) worker_.join();
+
+		// 末尾まで続いている無音・相関区間を閉じる
+		CloseSilence(pos_);
+		if (corr_count_ > 0) CloseCorrWindow(pos_);
+
+		report_.frames = pos_;
+		for (auto& c : report_.ch) {
+			c.dc_offset = (pos_ > 0) ? c.sum / (double)pos_ : 0.0;
+		}
+		report_.mean_corr = (corr_n_ > 0) ? (float)(corr_sum_ / (double)corr_n_) : 1.0f;
+		return report_;
+	}
+
+	void AudioAnalyzer::WorkerMain() {
+		for (;;) {
+			Chunk chunk;
+			{
+				std::unique_lock<std::mutex> lk(mutex_);
+				cv_.wait(lk, [&] { return closed_ || !queue_.empty(); });
+				if (queue_.empty()) return;
+				chunk = std::move(queue_.front());
+				queue_.pop_front();
+			}
+			Process(chunk.buf.As<float>(), chunk.frames);
+		}
+	}
+
+	void AudioAnalyzer::Process(const float* data, int frames) {
+		if (frames <= 0) return;
+		ProcessPeaks(data, frames);
+		ProcessFrames(data, frames);
+		pos_ += frames;
+	}
+
+	/// <summary>
+	/// ピーク・クリップ数 (と位置)・DC成分の合計を求める
+	/// </summary>
+	/// <description>
+	/// チャンネル数が 1/2/4 の場合は SSE2 の各レーンが常に同じチャンネルを指すので、
+	/// インターリーブのまま4サンプルずつ処理して最後にレーンをチャンネルへ畳み込む。
+	/// クリップ位置は比較結果のマスクが 0 でない (まれな) ときだけ取り出して記録する。
+	/// </description>
+	void AudioAnalyzer::ProcessPeaks(const float* data, int frames) {
+		const int ch = report_.channels;
+		const size_t total = (size_t)frames * ch;
+		size_t i = 0;
+
+		if (ch == 1 || ch == 2 || ch == 4) {
+			const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+			const __m128 clipLevel = _mm_set1_ps(settings_.clip_level);
+			__m128 peak = _mm_setzero_ps();
+			__m128i clips = _mm_setzero_si128();
+			__m128d sumLo = _mm_setzero_pd();
+			__m128d sumHi = _mm_setzero_pd();
+
+			for (; i + 4 <= total; i += 4) {
+				__m128 v = _mm_loadu_ps(data + i);
+				__m128 a = _mm_and_ps(v, absMask);
+				peak = _mm_max_ps(peak, a);
+				__m128 isClip = _mm_cmpge_ps(a, clipLevel);
+				clips = _mm_sub_epi32(clips, _mm_castps_si128(isClip));
+				if (int mask = _mm_movemask_ps(isClip)) {
+					for (int k = 0; k < 4; k++) {
+						if (mask & (1 << k)) RecordClip(i + k);
+					}
+				}
+				sumLo = _mm_add_pd(sumLo, _mm_cvtps_pd(v));
+				sumHi = _mm_add_pd(sumHi, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+			}
+
+			alignas(16) float lanePeak[4];
+			alignas(16) int32_t laneClips[4];
+			alignas(16) double laneSum[4];
+			_mm_store_ps(lanePeak, peak);
+			_mm_store_si128((__m128i*)laneClips, clips);
+			_mm_store_pd(laneSum, sumLo);
+			_mm_store_pd(laneSum + 2, sumHi);
+			for (int k = 0; k < 4; k++) {
+				auto& c = report_.ch[k % ch];
+				c.peak = std::max(c.peak, lanePeak[k]);
+				c.clip_count += (uint64_t)laneClips[k];
+				c.sum += laneSum[k];
+			}
+		}
+
+		// 端数、および SSE で扱えないチャンネル数
+		for (; i < total; i++) {
+			auto& c = report_.ch[i % ch];
+			float a = std::fabs(data[i]);
+			c.peak = std::max(c.peak, a);
+			if (a >= settings_.clip_level) {
+				c.clip_count++;
+				RecordClip(i);
+			}
+			c.sum += data[i];
+		}
+	}
+
+	// data の先頭から sample 番目 (インターリーブ) のクリップ位置を記録する
+	void AudioAnalyzer::RecordClip(size_t sample) {
+		const int ch = report_.channels;
+		auto& cp = report_.ch[sample % ch].clip_positions;
+		if (cp.size() < settings_.max_clip_positions) cp.push_back(pos_ + (int64_t)(sample / ch));
+	}
+
+	/// <summary>
+	/// サンプル単位の情報 (無音区間・L/R相関) を求める
+	/// </summary>
+	void AudioAnalyzer::ProcessFrames(const float* data, int frames) {
+		const int ch = report_.channels;
+
+		for (int f = 0; f < frames; f++) {
+			const float* s = data + (size_t)f * ch;
+			const int64_t at = pos_ + f;
+
+			float m = 0.0f;
+			for (int c = 0; c < ch; c++) m = std::max(m, std::fabs(s[c]));
+
+			if (m < silence_level_) {
+				if (silence_start_ < 0) silence_start_ = at;
+			}
+			else if (silence_start_ >= 0) {
+				CloseSilence(at);
+			}
+
+			if (ch >= 2) {
+				double l = s[0], r = s[1];
+				corr_ll_ += l * l;
+				corr_rr_ += r * r;
+				corr_lr_ += l * r;
+				if (++corr_count_ >= corr_window_frames_) CloseCorrWindow(at + 1);
+			}
+		}
+	}
+
+	void AudioAnalyzer::CloseSilence(int64_t end) {
+		if (silence_start_ >= 0 && end - silence_start_ >= silence_min_frames_) {
+			report_.silences.push_back({ silence_start_, end });
+		}
+		silence_start_ = -1;
+	}
+
+	void AudioAnalyzer::CloseCorrWindow(int64_t next_start) {
+		// 片側でも無音の区間は相関が定義できないので記録しない
+		constexpr double kEps = 1e-12;
+		if (corr_ll_ > kEps && corr_rr_ > kEps) {
+			float corr = (float)(corr_lr_ / std::sqrt(corr_ll_ * corr_rr_));
+			report_.correlation.push_back({ corr_start_, corr });
+			report_.min_corr = std::min(report_.min_corr, corr);
+			corr_sum_ += corr;
+			corr_n_++;
+		}
+		corr_start_ = next_start;
+		corr_count_ = 0;
+		corr_ll_ = corr_rr_ = corr_lr_ = 0.0;
+	}
+
+	std::vector<std::wstring> FindViolations(const AnalyzerReport& report, const AnalyzerSettings& settings) {
+		std::vector<std::wstring> v;
+		for (size_t i = 0; i < report.ch.size(); i++) {
+			const auto& c = report.ch[i];
+			std::wstring name = L"ch" + std::to_wstring(i + 1);
+			if (c.clip_count > 0) {
+				std::wstring msg = name + L": クリップ " + std::to_wstring(c.clip_count) + L" サンプル";
+				if (!c.clip_positions.empty()) msg += L" (最初の位置 " + std::to_wstring(c.clip_positions.front()) + L")";
+				v.push_back(msg);
+			}
+			if (std::fabs(c.dc_offset) > settings.dc_limit) {
+				v.push_back(name + L": DCオフセット " + std::to_wstring(c.dc_offset));
+			}
+		}
+		if (!report.silences.empty()) {
+			const auto& s = report.silences.front();
+			v.push_back(L"無音区間 " + std::to_wstring(report.silences.size()) + L" 箇所 (最初 " +
+				std::to_wstring(s.start) + L"-" + std::to_wstring(s.end) + L")");
+		}
+		if (report.channels >= 2 && report.min_corr < settings.corr_limit) {
+			v.push_back(L"L/R相関 最小 " + std::to_wstring(report.min_corr) + L" (モノラル互換性なし)");
+		}
+		return v;
+	}
+
+	bool WriteReportJson(const std::filesystem::path& path, const AnalyzerReport& report, const std::vector<std::wstring>& violations) {
+		std::string s = "{\n  \"rate\": ";
+		AppendJsonNumber(s, (int64_t)report.rate);
+		s += ",\n  \"channels\": ";
+		AppendJsonNumber(s, (int64_t)report.channels);
+		s += ",\n  \"frames\": ";
+		AppendJsonNumber(s, report.frames);
+
+		s += ",\n  \"channel_stats\": [";
+		for (size_t i = 0; i < report.ch.size(); i++) {
+			const auto& c = report.ch[i];
+			s += (i == 0) ? "\n    {" : ",\n    {";
+			s += "\"peak\": "; AppendJsonNumber(s, (double)c.peak);
+			s += ", \"peak_dbfs\": "; AppendJsonNumber(s, ToDbfs(c.peak));
+			s += ", \"clip_count\": "; AppendJsonNumber(s, (int64_t)c.clip_count);
+			s += ", \"clip_positions\": [";
+			for (size_t k = 0; k < c.clip_positions.size(); k++) {
+				if (k) s += ", ";
+				AppendJsonNumber(s, c.clip_positions[k]);
+			}
+			s += "], \"dc_offset\": "; AppendJsonNumber(s, c.dc_offset);
+			s += "}";
+		}
+		s += "\n  ],\n  \"silences\": [";
+		for (size_t i = 0; i < report.silences.size(); i++) {
+			s += (i == 0) ? "\n    {" : ",\n    {";
+			s += "\"start\": "; AppendJsonNumber(s, report.silences[i].start);
+			s += ", \"end\": "; AppendJsonNumber(s, report.silences[i].end);
+			s += "}";
+		}
+		s += "\n  ],\n  \"correlation\": {\"min\": ";
+		AppendJsonNumber(s, (double)report.min_corr);
+		s += ", \"mean\": ";
+		AppendJsonNumber(s, (double)report.mean_corr);
+		s += ", \"points\": [";
+		for (size_t i = 0; i < report.correlation.size(); i++) {
+			if (i) s += ", ";
+			s += "[";
+			AppendJsonNumber(s, report.correlation[i].start);
+			s += ", ";
+			AppendJsonNumber(s, (double)report.correlation[i].corr);
+			s += "]";
+		}
+		s += "]},\n  \"violations\": [";
+		for (size_t i = 0; i < violations.size(); i++) {
+			s += (i == 0) ? "\n    " : ",\n    ";
+			AppendJsonString(s, ToUtf8(violations[i]));
+		}
+		s += violations.empty() ? "],\n  \"passed\": true\n}\n" : "\n  ],\n  \"passed\": false\n}\n";
+
+		std::ofstream f(path, std::ios::binary | std::ios::trunc);
+		if (!f) return false;
+		f.write(s.data(), (std::streamsize)s.size());
+		return (bool)f;
+	}
+}
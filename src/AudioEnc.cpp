@@ -3,13 +3,26 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <chrono>
 #include <cstdio>
+#include <cstring>
 #include <filesystem>
+#include <memory>
+#include <optional>
 #include <pathcch.h>
 
 #include "output2.h"
 #include "module2.h"
+#include "logger2.h"
 #include "resource.h"
+#include "AudioAnalyzer.h"
+#include "BufferPool.h"
+#include "EncoderProcess.h"
+#include "EncoderTuner.h"
+#include "ExportJournal.h"
+#include "ExportVerifier.h"
+#include "SampleFormat.h"
+#include "TrackSplitter.h"
 
 #pragma comment(lib,"Comdlg32.lib")
 #pragma comment(lib,"Pathcch.lib")
@@ -22,12 +35,34 @@ namespace {
         int ogg_bitrate = 160;
         int samplerate = 48000; 
         int flac_level = 5;
+        int flac_bits = 24;         // FLAC の出力ビット深度 (16 / 24)
         int wav_bitdepth = 16;
+        bool mp3_auto = false;      // 描画速度に追いつける範囲で LAME の品質 (-q) を自動で選ぶ
+        bool opus_auto = false;     // 同、Opus の complexity
+        bool flac_auto = false;     // 同、FLAC の圧縮レベル
+        bool qc_enable = false;     // 品質チェック (クリップ・DC・無音・位相) を行う
+        bool qc_fail = false;       // 品質チェックで違反があれば出力を失敗扱いにする
+        int qc_silence_ms = 2000;
+        int qc_silence_db = -60;
+        bool verify = false;        // 出力後にデコードして内容を検証する
+        int split_mode = 0;         // トラック分割 (kSplitOff / kSplitSilence / kSplitRanges)
+        std::wstring split_ranges;  // 範囲指定の分割 "開始-終了,開始-終了" (サンプル単位)
+        int split_gap_ms = 2000;    // 無音で分割する場合の最小の無音長
+        int split_db = -50;         // 無音とみなすレベル (dBFS)
+        int pool_mb = 256;          // バッファプール全体の予算
+        int export_pool_mb = 64;    // 出力1回あたりのバッファ予算
+        bool large_pages = false;   // バッファプールにラージページを使う (要 SeLockMemoryPrivilege)
+        int fetch_mode = 0;         // ホストから受け取るサンプル形式 (kFetchAuto / kFetchFloat / kFetchPcm16Lossy)
+        bool fetch_bench = false;   // 出力前に float / PCM16 取得の速度と誤差を比べてログに出す
+        bool journal = true;        // 出力毎の記録をジャーナル (.journal.jsonl) に追記する
+        int journal_kb = 4096;      // ジャーナル1ファイルの上限
+        int journal_files = 4;      // ローテーションで残す古いジャーナルの数
         std::wstring current_preset = L"default";
     } g_config;
 
     HINSTANCE g_module = nullptr;
 	std::wstring g_iniPath;
+	LOG_HANDLE* g_logger = nullptr;
 
 	const wchar_t* INFO_STR = L"AudioEnc v1.5";
 	const wchar_t* PLUGIN_NAME = L"音声出力";
@@ -42,6 +77,19 @@ namespace {
 	const int kRates[] = { 32000, 44100, 48000, 88200, 96000 };
 	const int kBitrates[] = { 64, 80, 96, 128, 160, 192, 256, 320 };
 
+	constexpr int kSplitOff = 0;
+	constexpr int kSplitSilence = 1;
+	constexpr int kSplitRanges = 2;
+	const wchar_t* kSplitModeNames[] = { L"しない", L"無音で分割", L"範囲指定" };
+
+	constexpr int kFetchAuto = 0;           // 出力形式から決める (NegotiateFetchFormat)
+	constexpr int kFetchFloat = 1;          // 常に float で受け取る
+	constexpr int kFetchPcm16Lossy = 2;     // kFetchAuto に加えて MP3 / Opus も PCM16 で受け取る (0dBFS を超えた部分は飽和する)
+
+	constexpr int kBenchmarkSeconds = 10;   // 取得形式の比較に使う先頭部分の長さ
+	constexpr int kCalibrationSeconds = 5;  // 自動調整の較正に使う先頭部分の長さ
+	constexpr int kRetuneSeconds = 30;      // 自動調整を見直す間隔 (音声の長さ)
+
 
 	/// <summary>
 	/// DLLの場所から.iniファイルのパスを生成する
@@ -82,6 +130,18 @@ namespace {
 		return g_iniPath;
 	}
 
+	void LogInfo(const std::wstring& msg) {
+		if (g_logger) g_logger->info(g_logger, msg.c_str());
+	}
+
+	void LogWarn(const std::wstring& msg) {
+		if (g_logger) g_logger->warn(g_logger, msg.c_str());
+	}
+
+	void LogError(const std::wstring& msg) {
+		if (g_logger) g_logger->error(g_logger, msg.c_str());
+	}
+
 
 	void SaveToIni(const std::wstring& section) {
 		std::wstring p = GetIniPath().wstring();
@@ -90,7 +150,28 @@ namespace {
 		WritePrivateProfileStringW(section.c_str(), L"ogg", std::to_wstring(g_config.ogg_bitrate).c_str(), p.c_str());
 		WritePrivateProfileStringW(section.c_str(), L"sr", std::to_wstring(g_config.samplerate).c_str(), p.c_str());
 		WritePrivateProfileStringW(section.c_str(), L"flac", std::to_wstring(g_config.flac_level).c_str(), p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"flac_bits", std::to_wstring(g_config.flac_bits).c_str(), p.c_str());
 		WritePrivateProfileStringW(section.c_str(), L"wav", std::to_wstring(g_config.wav_bitdepth).c_str(), p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"mp3_auto", g_config.mp3_auto ? L"1" : L"0", p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"opus_auto", g_config.opus_auto ? L"1" : L"0", p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"flac_auto", g_config.flac_auto ? L"1" : L"0", p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"qc", g_config.qc_enable ? L"1" : L"0", p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"qc_fail", g_config.qc_fail ? L"1" : L"0", p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"qc_silence_ms", std::to_wstring(g_config.qc_silence_ms).c_str(), p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"qc_silence_db", std::to_wstring(g_config.qc_silence_db).c_str(), p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"verify", g_config.verify ? L"1" : L"0", p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"split", std::to_wstring(g_config.split_mode).c_str(), p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"split_ranges", g_config.split_ranges.c_str(), p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"split_gap_ms", std::to_wstring(g_config.split_gap_ms).c_str(), p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"split_db", std::to_wstring(g_config.split_db).c_str(), p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"pool_mb", std::to_wstring(g_config.pool_mb).c_str(), p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"export_pool_mb", std::to_wstring(g_config.export_pool_mb).c_str(), p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"large_pages", g_config.large_pages ? L"1" : L"0", p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"fetch", std::to_wstring(g_config.fetch_mode).c_str(), p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"fetch_bench", g_config.fetch_bench ? L"1" : L"0", p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"journal", g_config.journal ? L"1" : L"0", p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"journal_kb", std::to_wstring(g_config.journal_kb).c_str(), p.c_str());
+		WritePrivateProfileStringW(section.c_str(), L"journal_files", std::to_wstring(g_config.journal_files).c_str(), p.c_str());
 
 		WritePrivateProfileStringW(L"Settings", L"LastPreset", section.c_str(), p.c_str());
 		WritePrivateProfileStringW(nullptr, nullptr, nullptr, p.c_str());
@@ -105,7 +186,30 @@ namespace {
 		g_config.ogg_bitrate = GetPrivateProfileIntW(section.c_str(), L"ogg", 160, p.c_str());
 		g_config.samplerate = GetPrivateProfileIntW(section.c_str(), L"sr", 48000, p.c_str());
 		g_config.flac_level = GetPrivateProfileIntW(section.c_str(), L"flac", 5, p.c_str());
+		g_config.flac_bits = (GetPrivateProfileIntW(section.c_str(), L"flac_bits", 24, p.c_str()) == 16) ? 16 : 24;
 		g_config.wav_bitdepth = GetPrivateProfileIntW(section.c_str(), L"wav", 16, p.c_str());
+		g_config.mp3_auto = GetPrivateProfileIntW(section.c_str(), L"mp3_auto", 0, p.c_str()) != 0;
+		g_config.opus_auto = GetPrivateProfileIntW(section.c_str(), L"opus_auto", 0, p.c_str()) != 0;
+		g_config.flac_auto = GetPrivateProfileIntW(section.c_str(), L"flac_auto", 0, p.c_str()) != 0;
+		g_config.qc_enable = GetPrivateProfileIntW(section.c_str(), L"qc", 0, p.c_str()) != 0;
+		g_config.qc_fail = GetPrivateProfileIntW(section.c_str(), L"qc_fail", 0, p.c_str()) != 0;
+		g_config.qc_silence_ms = GetPrivateProfileIntW(section.c_str(), L"qc_silence_ms", 2000, p.c_str());
+		g_config.qc_silence_db = GetPrivateProfileIntW(section.c_str(), L"qc_silence_db", -60, p.c_str());
+		g_config.verify = GetPrivateProfileIntW(section.c_str(), L"verify", 0, p.c_str()) != 0;
+		g_config.split_mode = std::clamp((int)GetPrivateProfileIntW(section.c_str(), L"split", kSplitOff, p.c_str()), kSplitOff, kSplitRanges);
+		g_config.split_gap_ms = GetPrivateProfileIntW(section.c_str(), L"split_gap_ms", 2000, p.c_str());
+		g_config.split_db = GetPrivateProfileIntW(section.c_str(), L"split_db", -50, p.c_str());
+		g_config.pool_mb = std::max(16, (int)GetPrivateProfileIntW(section.c_str(), L"pool_mb", 256, p.c_str()));
+		g_config.export_pool_mb = std::max(4, (int)GetPrivateProfileIntW(section.c_str(), L"export_pool_mb", 64, p.c_str()));
+		g_config.large_pages = GetPrivateProfileIntW(section.c_str(), L"large_pages", 0, p.c_str()) != 0;
+		g_config.fetch_mode = std::clamp((int)GetPrivateProfileIntW(section.c_str(), L"fetch", kFetchAuto, p.c_str()), kFetchAuto, kFetchPcm16Lossy);
+		g_config.fetch_bench = GetPrivateProfileIntW(section.c_str(), L"fetch_bench", 0, p.c_str()) != 0;
+		g_config.journal = GetPrivateProfileIntW(section.c_str(), L"journal", 1, p.c_str()) != 0;
+		g_config.journal_kb = std::max(64, (int)GetPrivateProfileIntW(section.c_str(), L"journal_kb", 4096, p.c_str()));
+		g_config.journal_files = std::clamp((int)GetPrivateProfileIntW(section.c_str(), L"journal_files", 4, p.c_str()), 0, 99);
+		wchar_t ranges[4096]{};
+		GetPrivateProfileStringW(section.c_str(), L"split_ranges", L"", ranges, 4096, p.c_str());
+		g_config.split_ranges = ranges;
 		g_config.current_preset = section;
 		return true;
 	}
@@ -117,7 +221,7 @@ namespace {
 			wchar_t* p = buf;
 			while (*p) {
 				std::wstring s(p);
-				if (s != L"Settings") names.push_back(s);
+				if (s != L"Settings" && s != L"AutoTune") names.push_back(s);
 				p += s.length() + 1;
 			}
 		}
@@ -128,6 +232,14 @@ namespace {
 	void SyncConfigToUI(HWND h) {
 		SetDlgItemInt(h, EDIT_FLAC_LEVEL, g_config.flac_level, FALSE);
 		SetDlgItemInt(h, EDIT_WAV_BITDEPTH, g_config.wav_bitdepth, FALSE);
+		CheckDlgButton(h, IDC_MP3_AUTO, g_config.mp3_auto ? BST_CHECKED : BST_UNCHECKED);
+		CheckDlgButton(h, IDC_OPUS_AUTO, g_config.opus_auto ? BST_CHECKED : BST_UNCHECKED);
+		CheckDlgButton(h, IDC_FLAC_AUTO, g_config.flac_auto ? BST_CHECKED : BST_UNCHECKED);
+		CheckDlgButton(h, IDC_QC_ENABLE, g_config.qc_enable ? BST_CHECKED : BST_UNCHECKED);
+		CheckDlgButton(h, IDC_QC_FAIL, g_config.qc_fail ? BST_CHECKED : BST_UNCHECKED);
+		CheckDlgButton(h, IDC_VERIFY, g_config.verify ? BST_CHECKED : BST_UNCHECKED);
+		SendDlgItemMessageW(h, IDC_SPLIT_MODE, CB_SETCURSEL, g_config.split_mode, 0);
+		SetDlgItemTextW(h, IDC_SPLIT_RANGES, g_config.split_ranges.c_str());
 
 		auto SelectValue = [&](int id, int val) {
 			int count = (int)SendDlgItemMessageW(h, id, CB_GETCOUNT, 0, 0);
@@ -154,6 +266,17 @@ namespace {
 		GetDlgItemTextW(h, IDC_OGG_BITRATE, buf, 64);  g_config.ogg_bitrate = _wtoi(buf);
 		g_config.flac_level = GetDlgItemInt(h, EDIT_FLAC_LEVEL, nullptr, FALSE);
 		g_config.wav_bitdepth = GetDlgItemInt(h, EDIT_WAV_BITDEPTH, nullptr, FALSE);
+		g_config.mp3_auto = IsDlgButtonChecked(h, IDC_MP3_AUTO) == BST_CHECKED;
+		g_config.opus_auto = IsDlgButtonChecked(h, IDC_OPUS_AUTO) == BST_CHECKED;
+		g_config.flac_auto = IsDlgButtonChecked(h, IDC_FLAC_AUTO) == BST_CHECKED;
+		g_config.qc_enable = IsDlgButtonChecked(h, IDC_QC_ENABLE) == BST_CHECKED;
+		g_config.qc_fail = IsDlgButtonChecked(h, IDC_QC_FAIL) == BST_CHECKED;
+		g_config.verify = IsDlgButtonChecked(h, IDC_VERIFY) == BST_CHECKED;
+		int split = (int)SendDlgItemMessageW(h, IDC_SPLIT_MODE, CB_GETCURSEL, 0, 0);
+		g_config.split_mode = (split == CB_ERR) ? kSplitOff : split;
+		wchar_t ranges[4096]{};
+		GetDlgItemTextW(h, IDC_SPLIT_RANGES, ranges, 4096);
+		g_config.split_ranges = ranges;
 		GetDlgItemTextW(h, IDC_PRESET_COMBO, buf, 128);
 		g_config.current_preset = (wcslen(buf) > 0) ? buf : L"default";
 	}
@@ -170,6 +293,9 @@ namespace {
 			for (int r : kRates) {
 				SendDlgItemMessageW(h, IDC_SAMPLE_RATE, CB_ADDSTRING, 0, (LPARAM)std::to_wstring(r).c_str());
 			}
+			for (auto name : kSplitModeNames) {
+				SendDlgItemMessageW(h, IDC_SPLIT_MODE, CB_ADDSTRING, 0, (LPARAM)name);
+			}
 			auto names = GetPresetNames();
 			for (auto& n : names) SendDlgItemMessageW(h, IDC_PRESET_COMBO, CB_ADDSTRING, 0, (LPARAM)n.c_str());
 			SyncConfigToUI(h);
@@ -207,7 +333,163 @@ namespace {
 		return (INT_PTR)DialogBoxW(g_module, MAKEINTRESOURCEW(IDD_CONFIG_DIALOG), h, ConfigDlgProc) == IDOK;
 	}
 
-	bool OutputFunc(OUTPUT_INFO* oi) {
+	/// <summary>
+	/// 品質チェックの結果をログとレポートファイル (出力ファイル名 + .qc.json) に出力する
+	/// </summary>
+	/// <returns>違反が無ければtrue</returns>
+	bool ReportQc(const std::filesystem::path& savefile, const AudioEnc::AnalyzerReport& report, const AudioEnc::AnalyzerSettings& settings) {
+		auto violations = AudioEnc::FindViolations(report, settings);
+
+		for (size_t i = 0; i < report.ch.size(); i++) {
+			const auto& c = report.ch[i];
+			LogInfo(L"QC ch" + std::to_wstring(i + 1) + L": peak " + std::to_wstring(c.peak) +
+				L", clip " + std::to_wstring(c.clip_count) + L", DC " + std::to_wstring(c.dc_offset));
+		}
+		if (report.channels >= 2) {
+			LogInfo(L"QC L/R相関: 最小 " + std::to_wstring(report.min_corr) + L", 平均 " + std::to_wstring(report.mean_corr));
+		}
+		for (auto& v : violations) LogWarn(L"QC " + v);
+
+		std::filesystem::path reportPath = savefile;
+		reportPath += L".qc.json";
+		if (!AudioEnc::WriteReportJson(reportPath, report, violations)) {
+			LogWarn(L"QCレポートを書き込めません: " + reportPath.wstring());
+		}
+		return violations.empty();
+	}
+
+	/// <summary>
+	/// 出力ファイルの検証をバックグラウンドで開始する。結果はログに出力する
+	/// </summary>
+	void StartVerify(const std::filesystem::path& savefile, const std::string& ext, bool exact,
+		std::shared_ptr<AudioEnc::PcmDigest> digest, double encodeSeconds) {
+		AudioEnc::VerifyJob job;
+		job.file = savefile;
+		job.ext = ext;
+		job.exact = exact;
+		job.digest = std::move(digest);
+		job.encode_seconds = encodeSeconds;
+
+		AudioEnc::StartBackgroundVerify(std::move(job), [](const AudioEnc::VerifyJob& job, const AudioEnc::VerifyResult& r) {
+			// 検証がエンコード時間に対してどの程度かかっているかを併せて出す
+			wchar_t bench[128];
+			double ratio = (job.encode_seconds > 0.0) ? r.seconds / job.encode_seconds * 100.0 : 0.0;
+			double mbps = (r.seconds > 0.0) ? r.bytes_decoded / r.seconds / (1024.0 * 1024.0) : 0.0;
+			swprintf(bench, 128, L" [検証 %.2f秒 / エンコード %.2f秒 (%.0f%%), %.1f MB/s]", r.seconds, job.encode_seconds, ratio, mbps);
+
+			std::wstring msg = job.file.filename().wstring() + L": " + r.message + bench;
+			if (r.ok) LogInfo(L"検証OK " + msg);
+			else LogError(L"検証NG " + msg);
+		});
+	}
+
+	/// <summary>
+	/// 拡張子から ffmpeg のコーデック指定を生成する
+	/// </summary>
+	/// <param name="level">自動調整で選んだ設定 (FLAC の圧縮レベル, Opus の complexity, LAME の -q)。-1 なら既定</param>
+	std::string BuildCodecArgs(const std::string& ext, int level = -1) {
+		std::string codec;
+		if (ext == ".mp3")  codec = "-c:a libmp3lame -b:a " + std::to_string(g_config.mp3_bitrate) + "k";
+		else if (ext == ".opus") codec = "-c:a libopus -b:a " + std::to_string(g_config.opus_bitrate) + "k";
+		else if (ext == ".flac") {
+			codec = "-c:a flac -compression_level " + std::to_string(level >= 0 ? level : g_config.flac_level);
+			if (g_config.flac_bits == 16) codec += " -sample_fmt s16";
+		}
+		else if (ext == ".ogg")  codec = "-c:a libvorbis -b:a " + std::to_string(g_config.ogg_bitrate) + "k";
+		else {
+			codec = (g_config.wav_bitdepth == 24) ? "-c:a pcm_s24le" :
+				(g_config.wav_bitdepth == 32) ? "-c:a pcm_s32le" : "-c:a pcm_s16le";
+		}
+		if (level >= 0 && (ext == ".mp3" || ext == ".opus")) codec += " -compression_level " + std::to_string(level);
+		return codec;
+	}
+
+	/// <summary>
+	/// 自動調整が有効な形式なら、その調整対象 (速い設定から強い設定の順) を返す
+	/// </summary>
+	std::optional<AudioEnc::TuneTarget> GetTuneTarget(const std::string& ext) {
+		if (ext == ".flac" && g_config.flac_auto) return AudioEnc::TuneTarget{ L"flac", L"FLAC 圧縮レベル", { 0, 1, 2, 3, 4, 5, 6, 7, 8 } };
+		// Opus / LAME の速度はビットレートでも大きく変わるので、プロファイルはビットレート毎に持つ
+		if (ext == ".opus" && g_config.opus_auto) {
+			return AudioEnc::TuneTarget{ L"opus" + std::to_wstring(g_config.opus_bitrate) + L"k_", L"Opus complexity", { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 } };
+		}
+		// LAME は -q の値が小さいほど高品質で遅い
+		if (ext == ".mp3" && g_config.mp3_auto) {
+			return AudioEnc::TuneTarget{ L"mp3" + std::to_wstring(g_config.mp3_bitrate) + L"k_", L"MP3 品質 (-q)", { 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 } };
+		}
+		return std::nullopt;
+	}
+
+	void LogTuneDecision(const AudioEnc::EncoderTuner& tuner, int level, double renderFps, int rate, const wchar_t* when) {
+		wchar_t buf[256];
+		swprintf(buf, 256, L"自動調整%s (%s): 描画 %.1f倍速 → %d (エンコード %.1f倍速)", when, tuner.Target().name.c_str(),
+			renderFps / rate, level, tuner.Throughput(level) / rate);
+		LogInfo(buf);
+	}
+
+	/// <summary>
+	/// 標準入力から fetch 形式の PCM を受け取り out に書き出す ffmpeg のコマンドラインを生成する
+	/// </summary>
+	std::wstring BuildEncoderCommand(AudioEnc::FetchFormat fetch, int inRate, int channels, const std::filesystem::path& out, const std::string& codec) {
+		char outUtf8[MAX_PATH * 3]{};
+		WideCharToMultiByte(CP_UTF8, 0, out.wstring().c_str(), -1, outUtf8, sizeof(outUtf8), nullptr, nullptr);
+
+		std::string cmd = "ffmpeg -threads 0 -y " + AudioEnc::FfmpegInputArgs(fetch, inRate, channels) +
+			" -i - -ar " + std::to_string(g_config.samplerate) + " " + codec + " \"" + outUtf8 + "\"";
+
+		std::wstring wcmd;
+		if (!cmd.empty()) {
+			int sizeNeeded = MultiByteToWideChar(CP_UTF8, 0, cmd.c_str(), -1, NULL, 0);
+			if (sizeNeeded > 0) {
+				wcmd.resize(sizeNeeded - 1); // ヌル文字分を引いてリサイズ
+				MultiByteToWideChar(CP_UTF8, 0, cmd.c_str(), -1, &wcmd[0], sizeNeeded);
+			}
+		}
+		return wcmd;
+	}
+
+	void LogFetchBenchmark(const AudioEnc::FetchBenchResult& r, int rate, AudioEnc::FetchFormat chosen) {
+		if (!r.ok) {
+			LogWarn(L"取得形式の比較: ffmpeg でのエンコードに失敗しました");
+			return;
+		}
+		const double sec = (double)r.frames / rate;
+		for (int i = 0; i < 2; i++) {
+			wchar_t buf[256];
+			swprintf(buf, 256, L"取得形式の比較 (%s): 取得 %.1f倍速, エンコード %.1f倍速, 転送 %.1f MB",
+				i == 0 ? L"float" : L"PCM16", sec / std::max(r.fetch_seconds[i], 1e-6), sec / std::max(r.encode_seconds[i], 1e-6),
+				r.bytes[i] / 1048576.0);
+			LogInfo(buf);
+		}
+		wchar_t buf[256];
+		swprintf(buf, 256, L"取得形式の比較: PCM16 の S/N %.1f dB, 最大誤差 %.2g, 飽和 %llu サンプル → %s で出力します",
+			r.snr_db, r.max_error, (unsigned long long)r.clipped, AudioEnc::FetchFormatName(chosen));
+		if (r.clipped > 0 && chosen == AudioEnc::FetchFormat::Pcm16) LogWarn(buf);
+		else LogInfo(buf);
+	}
+
+	void LogPoolStats(const AudioEnc::ExportBudget& budget) {
+		auto st = AudioEnc::BufferPool::Instance().Stats();
+		wchar_t buf[256];
+		swprintf(buf, 256, L"バッファプール: この出力のピーク %.1f MB (%llu 回, 待機 %llu 回, 予算外 %llu 回), 全体のピーク %.1f MB / 確保 %.1f MB, OS確保 %llu 回, 再利用 %llu 回%s",
+			budget.PeakInUse() / 1048576.0, (unsigned long long)budget.Acquires(), (unsigned long long)budget.Waits(), (unsigned long long)budget.Overflows(),
+			st.peak_in_use / 1048576.0, st.peak_reserved / 1048576.0,
+			(unsigned long long)st.allocations, (unsigned long long)st.reuses, st.large_pages ? L", ラージページ" : L"");
+		LogInfo(buf);
+	}
+
+	std::string ToUtf8(const std::wstring& w) {
+		if (w.empty()) return {};
+		int size = WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(), nullptr, 0, nullptr, nullptr);
+		std::string s(size, '\0');
+		WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(), s.data(), size, nullptr, nullptr);
+		return s;
+	}
+
+	/// <summary>
+	/// 出力本体。各段階の時間や結果を rec に記録する
+	/// </summary>
+	bool RunExport(OUTPUT_INFO* oi, AudioEnc::JournalRecord& rec) {
 		// ffmpegの起動チェック
 		{
 			STARTUPINFOW si = { sizeof(si) };
@@ -223,101 +505,372 @@ namespace {
 			}
 			else {
 				MessageBoxW(nullptr, L"ffmpeg が見つかりません。", L"AudioEnc", MB_ICONERROR);
+				rec.error = "ffmpeg not found";
 				return false;
 			}
 		}
 
-		// コマンドラインの生成
-		char out[MAX_PATH * 3]{};
-		WideCharToMultiByte(CP_UTF8, 0, oi->savefile, -1, out, sizeof(out), nullptr, nullptr);
-
 		std::filesystem::path p(oi->savefile);
 		std::string ext = p.extension().string();
 		std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+		std::string codec = BuildCodecArgs(ext);
+		rec.format = ext;
+
+		using Clock = std::chrono::steady_clock;
+		auto elapsed = [](Clock::time_point t0) { return std::chrono::duration<double>(Clock::now() - t0).count(); };
+
+		// 解析などの中間バッファはプールから出力毎の予算内で借りる
+		auto& pool = AudioEnc::BufferPool::Instance();
+		pool.Configure((size_t)g_config.pool_mb << 20, g_config.large_pages);
+		AudioEnc::ExportBudget budget(pool, (size_t)g_config.export_pool_mb << 20);
+
+		// ホストから受け取る形式。16bit 相当の精度で足りる出力 (リサンプルなし) なら PCM16 で受け取り、取得とパイプの転送量を半分にする
+		const int targetBits = (ext == ".wav") ? g_config.wav_bitdepth : (ext == ".flac") ? g_config.flac_bits : 0;
+		const AudioEnc::FetchFormat fetch = (g_config.fetch_mode == kFetchFloat) ? AudioEnc::FetchFormat::Float :
+			AudioEnc::NegotiateFetchFormat(ext, targetBits, oi->audio_rate, g_config.samplerate, g_config.fetch_mode == kFetchPcm16Lossy);
+		const size_t frameBytes = (size_t)oi->audio_ch * AudioEnc::BytesPerSample(fetch);
+		rec.fetch = (fetch == AudioEnc::FetchFormat::Pcm16) ? "pcm16" : "float";
+
+		if (g_config.fetch_bench) {
+			auto t0 = Clock::now();
+			auto result = AudioEnc::RunFetchBenchmark(
+				[&](int start, int length, int* readed, int format) -> const void* { return oi->func_get_audio(start, length, readed, (DWORD)format); },
+				std::min(oi->audio_n, oi->audio_rate * kBenchmarkSeconds), oi->audio_rate, oi->audio_ch, g_config.samplerate, codec);
+			LogFetchBenchmark(result, oi->audio_rate, fetch);
+			AddStage(rec, "benchmark", elapsed(t0));
+		}
 
-		std::string codec;
-		if (ext == ".mp3")  codec = "-c:a libmp3lame -b:a " + std::to_string(g_config.mp3_bitrate) + "k";
-		else if (ext == ".opus") codec = "-c:a libopus -b:a " + std::to_string(g_config.opus_bitrate) + "k";
-		else if (ext == ".flac") codec = "-c:a flac -compression_level " + std::to_string(g_config.flac_level);
-		else if (ext == ".ogg")  codec = "-c:a libvorbis -b:a " + std::to_string(g_config.ogg_bitrate) + "k";
-		else {
-			codec = (g_config.wav_bitdepth == 24) ? "-c:a pcm_s24le" :
-				(g_config.wav_bitdepth == 32) ? "-c:a pcm_s32le" : "-c:a pcm_s16le";
+		// 品質チェックはワーカースレッドで行い、ここではバッファを渡すだけにする
+		AudioEnc::AnalyzerSettings qcSettings;
+		qcSettings.silence_db = g_config.qc_silence_db;
+		qcSettings.silence_min_ms = g_config.qc_silence_ms;
+		std::unique_ptr<AudioEnc::AudioAnalyzer> analyzer;
+		if (g_config.qc_enable) {
+			analyzer = std::make_unique<AudioEnc::AudioAnalyzer>(oi->audio_rate, oi->audio_ch, qcSettings, budget);
 		}
 
-		std::string cmd = "ffmpeg -threads 0 -y -f f32le -sample_fmt flt -ar " +
-			std::to_string(oi->audio_rate) + " -ac " + std::to_string(oi->audio_ch) +
-			" -i - -ar " + std::to_string(g_config.samplerate) + " " + codec + " \"" + out + "\"";
+		// 検証用のダイジェスト。可逆形式でリサンプルしない場合はハッシュの完全一致、それ以外は帯域エネルギーで比較する
+		// 32bit WAV は ffmpeg の float -> s32 変換の飽和値が C 版と SIMD 版で異なるため、完全一致の対象にしない
+		const bool exactVerify = (ext == ".wav" || ext == ".flac") && g_config.samplerate == oi->audio_rate
+			&& !(ext == ".wav" && g_config.wav_bitdepth == 32);
 
-		std::wstring wcmd;
-		if (!cmd.empty()) {
-			int sizeNeeded = MultiByteToWideChar(CP_UTF8, 0, cmd.c_str(), -1, NULL, 0);
-			if (sizeNeeded > 0) {
-				wcmd.resize(sizeNeeded - 1); // ヌル文字分を引いてリサイズ
-				MultiByteToWideChar(CP_UTF8, 0, cmd.c_str(), -1, &wcmd[0], sizeNeeded);
+		// トラック分割
+		std::optional<AudioEnc::TrackSplitter> splitter;
+		if (g_config.split_mode == kSplitSilence) {
+			splitter = AudioEnc::TrackSplitter::FromSilence(oi->audio_rate, oi->audio_ch, g_config.split_gap_ms, g_config.split_db);
+		}
+		else if (g_config.split_mode == kSplitRanges) {
+			auto ranges = AudioEnc::ParseSampleRanges(g_config.split_ranges, oi->audio_n);
+			if (ranges.empty()) LogWarn(L"分割範囲が指定されていないため分割せずに出力します");
+			else splitter = AudioEnc::TrackSplitter::FromRanges(oi->audio_ch, std::move(ranges));
+		}
+		if (splitter && g_config.samplerate != oi->audio_rate) {
+			LogWarn(L"リサンプルするため、トラック境界はサンプル単位で正確になりません");
+		}
+
+		// トラック毎のエンコーダ。分割しない場合はトラック0のみ
+		struct Track {
+			std::filesystem::path file;
+			std::unique_ptr<AudioEnc::EncoderProcess> encoder;
+			std::shared_ptr<AudioEnc::PcmDigest> digest;
+		};
+		std::vector<Track> tracks;
+		bool failed = false;
+
+		constexpr int CHUNK = 4096;
+
+		// PCM16 で受け取っても解析・分割・検証は float で行うので、その変換用のバッファ
+		const bool needFloat = analyzer || splitter || g_config.verify;
+		AudioEnc::PooledBuffer scratchFloat;
+		AudioEnc::PooledBuffer scratch16;
+		if (fetch == AudioEnc::FetchFormat::Pcm16 && needFloat) {
+			scratchFloat = budget.Acquire((size_t)CHUNK * oi->audio_ch * sizeof(float));
+			scratch16 = budget.Acquire((size_t)CHUNK * frameBytes);
+		}
+
+		auto openTrack = [&](int index) -> Track* {
+			if ((int)tracks.size() <= index) tracks.resize(index + 1);
+			Track& t = tracks[index];
+			if (!t.encoder) {
+				t.file = splitter ? AudioEnc::TrackFilePath(p, index) : p;
+				t.encoder = std::make_unique<AudioEnc::EncoderProcess>();
+				if (!t.encoder->Start(BuildEncoderCommand(fetch, oi->audio_rate, oi->audio_ch, t.file, codec))) {
+					failed = true;
+					return nullptr;
+				}
+				if (g_config.verify) {
+					t.digest = std::make_shared<AudioEnc::PcmDigest>(oi->audio_rate, oi->audio_ch, !exactVerify);
+				}
+			}
+			return &t;
+		};
+		auto writeTrack = [&](int index, const float* data, int frames) {
+			if (failed) return;
+			Track* t = openTrack(index);
+			if (!t) return;
+			if (t->digest) t->digest->Update(data, frames);
+			if (fetch == AudioEnc::FetchFormat::Float) {
+				if (!t->encoder->Write(data, (size_t)frames * frameBytes)) failed = true;
+				return;
+			}
+			// PCM16 から変換した値なので誤差なく戻る
+			for (int i = 0; i < frames && !failed; i += CHUNK) {
+				int n = std::min(CHUNK, frames - i);
+				AudioEnc::FloatToPcm16(data + (size_t)i * oi->audio_ch, scratch16.As<int16_t>(), (size_t)n * oi->audio_ch);
+				if (!t->encoder->Write(scratch16.Data(), (size_t)n * frameBytes)) failed = true;
+			}
+		};
+		auto endTrack = [&](int index) {
+			// 入力を閉じるだけで終了は待たない (次のトラックのエンコーダと並行して動かす)
+			if (index < (int)tracks.size() && tracks[index].encoder) tracks[index].encoder->CloseInput();
+		};
+
+		auto consume = [&](const float* buf, int r) {
+			if (analyzer) analyzer->Push(buf, r);
+
+			if (splitter) splitter->Feed(buf, r, writeTrack, endTrack);
+			else writeTrack(0, buf, r);
+		};
+		// ホストから受け取ったままのデータ (fetch 形式, r <= CHUNK) を処理する
+		auto consumeRaw = [&](const void* buf, int r) {
+			if (fetch == AudioEnc::FetchFormat::Float) {
+				consume((const float*)buf, r);
+			}
+			else if (!needFloat) {
+				// float が要らなければホストの PCM16 をそのまま書き込む
+				Track* t = openTrack(0);
+				if (t && !t->encoder->Write(buf, (size_t)r * frameBytes)) failed = true;
+			}
+			else {
+				AudioEnc::Pcm16ToFloat((const int16_t*)buf, scratchFloat.As<float>(), (size_t)r * oi->audio_ch);
+				consume(scratchFloat.As<float>(), r);
+			}
+		};
+		auto writeSeconds = [&] {
+			double sec = 0.0;
+			for (auto& t : tracks) if (t.encoder) sec += t.encoder->WriteSeconds();
+			return sec;
+		};
+		bool isAborted = false;
+		int start = 0;
+
+		// 自動調整: 先頭部分を先に取得して描画速度を測り、同じデータで未計測の設定を較正エンコードする
+		std::optional<AudioEnc::EncoderTuner> tuner;
+		// 一度きりの大きなバッファなので予算 (プール) の外で確保する
+		std::vector<uint8_t> prefetch;
+		int prefetchFrames = 0;
+		int level = -1;
+		auto target = GetTuneTarget(ext);
+		if (target && oi->audio_n >= oi->audio_rate) {
+			tuner.emplace(std::move(*target), GetIniPath(), oi->audio_rate, oi->audio_ch, g_config.samplerate);
+			const int calibFrames = std::min(oi->audio_n, oi->audio_rate * kCalibrationSeconds);
+			prefetch.resize((size_t)calibFrames * frameBytes);
+
+			double fetchSeconds = 0.0;
+			for (; start < calibFrames; start += CHUNK) {
+				if (oi->func_is_abort()) {
+					isAborted = true;
+					break;
+				}
+				int r = 0;
+				int n = std::min(CHUNK, calibFrames - start);
+				auto t0 = Clock::now();
+				void* buf = oi->func_get_audio(start, n, &r, AudioEnc::HostFormatId(fetch));
+				fetchSeconds += elapsed(t0);
+				if (buf && r > 0) {
+					r = std::min(r, n);
+					memcpy(prefetch.data() + (size_t)prefetchFrames * frameBytes, buf, (size_t)r * frameBytes);
+					prefetchFrames += r;
+				}
+			}
+
+			if (!isAborted && prefetchFrames > 0) {
+				AudioEnc::CalibrationData calib;
+				calib.chunks.push_back({ prefetch.data(), (size_t)prefetchFrames * frameBytes });
+				calib.input_args = AudioEnc::FfmpegInputArgs(fetch, oi->audio_rate, oi->audio_ch);
+				calib.frames = prefetchFrames;
+				calib.rate = oi->audio_rate;
+				calib.channels = oi->audio_ch;
+				calib.out_rate = g_config.samplerate;
+
+				double renderFps = prefetchFrames / std::max(fetchSeconds, 1e-6);
+				auto t0 = Clock::now();
+				level = tuner->Choose(renderFps, calib, [&](int lv) { return BuildCodecArgs(ext, lv); });
+				AddStage(rec, "calibration", elapsed(t0));
+				codec = BuildCodecArgs(ext, level);
+				LogTuneDecision(*tuner, level, renderFps, oi->audio_rate, L"");
+				rec.settings.emplace_back("auto_level", level);
+			}
+			else {
+				tuner.reset();
 			}
+			AddStage(rec, "fetch", fetchSeconds);
+			// 較正エンコードの間に中断された場合も、エンコーダを起動せずに終える
+			if (!isAborted && oi->func_is_abort()) isAborted = true;
 		}
 
-		// パイプの作成とプロセスの起動
-		HANDLE hPipeRead = NULL;
-		HANDLE hPipeWrite = NULL;
-		SECURITY_ATTRIBUTES saAttr = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE }; // ハンドル継承を許可
-		if (!CreatePipe(&hPipeRead, &hPipeWrite, &saAttr, 0)) {
+		if (!isAborted && !splitter && !openTrack(0)) {
+			rec.error = "failed to start ffmpeg";
 			return false;
 		}
-		SetHandleInformation(hPipeWrite, HANDLE_FLAG_INHERIT, 0);
-
-		STARTUPINFOW si = { sizeof(si) };
-		PROCESS_INFORMATION pi = { 0 };
-		si.dwFlags = STARTF_USESTDHANDLES | STARTF_USESHOWWINDOW;
-		si.hStdInput = hPipeRead;
-		si.hStdOutput = NULL;
-		si.hStdError = NULL;
-		si.wShowWindow = SW_SHOWNORMAL;
-		BOOL processCreated = CreateProcessW(NULL, wcmd.empty() ? NULL : &wcmd[0], NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi);
-		CloseHandle(hPipeRead);
-		if (!processCreated) {
-			CloseHandle(hPipeWrite);
-			return false;
+
+		// 出力開始 (中断された場合は先読みした分も書き出さない)
+		for (int i = 0; i < prefetchFrames && !isAborted && !failed; i += CHUNK) {
+			consumeRaw(prefetch.data() + (size_t)i * frameBytes, std::min(CHUNK, prefetchFrames - i));
 		}
+		prefetch = {};
 
-		// 出力開始
-		constexpr int CHUNK = 4096;
-		bool isAborted = false;
+		// 見直し用の区間の計測値
+		auto windowStart = Clock::now();
+		double windowFetch = 0.0;
+		double windowBlocked = writeSeconds();
+		int windowFrames = 0;
+		double fetchTotal = 0.0;
 
-		for (int i = 0; i < oi->audio_n; i += CHUNK) {
+		for (int i = start; i < oi->audio_n && !isAborted && !failed; i += CHUNK) {
 			if (oi->func_is_abort()) {
 				isAborted = true;
 				break;
 			}
 			int r = 0;
 			int n = std::min(CHUNK, oi->audio_n - i);
-			float* buf = (float*)oi->func_get_audio(i, n, &r, 3);
+			auto t0 = Clock::now();
+			void* buf = oi->func_get_audio(i, n, &r, AudioEnc::HostFormatId(fetch));
+			double fetchSec = elapsed(t0);
+			windowFetch += fetchSec;
+			fetchTotal += fetchSec;
 
 			if (buf && r > 0) {
-				DWORD bytesWritten = 0;
-				size_t bytesToWrite = (size_t)r * oi->audio_ch * sizeof(float);
+				consumeRaw(buf, std::min(r, n));
 
-				if (!WriteFile(hPipeWrite, buf, (DWORD)bytesToWrite, &bytesWritten, NULL)) {
+				if (failed) {
 					// ffmpeg 側が途中で落ちた、または終了した場合
 					break;
 				}
+				windowFrames += r;
+			}
+
+			if (tuner && windowFrames >= oi->audio_rate * kRetuneSeconds) {
+				// 書き込みで待たされている割合が大きければエンコーダが律速している
+				double wall = elapsed(windowStart);
+				double blocked = writeSeconds() - windowBlocked;
+				double renderFps = windowFrames / std::max(windowFetch, 1e-6);
+				double encoderFps = windowFrames / std::max(wall, 1e-6);
+				int next = tuner->Reevaluate(level, renderFps, encoderFps, blocked > wall * 0.25);
+				if (next != level) {
+					level = next;
+					codec = BuildCodecArgs(ext, level);
+					LogTuneDecision(*tuner, level, renderFps, oi->audio_rate, splitter ? L"の変更 (次のトラックから)" : L"の変更 (次回の出力から)");
+				}
+				windowStart = Clock::now();
+				windowFetch = 0.0;
+				windowBlocked = writeSeconds();
+				windowFrames = 0;
 			}
 		}
-		CloseHandle(hPipeWrite);
+		if (splitter && !isAborted && !failed) {
+			splitter->Finish(writeTrack, endTrack);
+		}
+		AddStage(rec, "fetch", fetchTotal);
+		AddStage(rec, "encode_write", writeSeconds());
+		rec.aborted = isAborted;
 
 		// プロセスの終了処理とクリーンアップ
+		auto waitStart = Clock::now();
+		for (auto& t : tracks) {
+			if (!t.encoder) continue;
+			rec.tracks++;
+			rec.pipe_bytes += t.encoder->BytesWritten();
+			if (isAborted) {
+				t.encoder->Terminate();
+				continue;
+			}
+			DWORD exitCode = t.encoder->Wait();
+			if (rec.exit_code <= 0) rec.exit_code = exitCode;
+			if (exitCode != 0 || t.encoder->Broken()) {
+				LogError(L"ffmpeg が異常終了しました (" + t.file.filename().wstring() + L", 終了コード " + std::to_wstring(exitCode) + L")");
+				failed = true;
+			}
+			std::error_code ec;
+			auto size = std::filesystem::file_size(t.file, ec);
+			if (!ec) rec.output_bytes += size;
+		}
+		AddStage(rec, "encoder_wait", elapsed(waitStart));
+		if (!isAborted && failed) {
+			rec.error = "encoder failed";
+			return false;
+		}
+		LogPoolStats(budget);
+
 		if (!isAborted) {
-			WaitForSingleObject(pi.hProcess, INFINITE);
+			for (auto& t : tracks) {
+				if (t.digest) StartVerify(t.file, ext, exactVerify, t.digest, t.encoder->Seconds());
+			}
 		}
-		else {
-			TerminateProcess(pi.hProcess, 0);
+
+		if (splitter && !isAborted) {
+			std::vector<AudioEnc::TrackInfo> info;
+			const auto& ranges = splitter->Tracks();
+			for (size_t i = 0; i < ranges.size() && i < tracks.size(); i++) {
+				info.push_back({ tracks[i].file, ranges[i].start, ranges[i].end });
+			}
+			std::filesystem::path cuePath = p;
+			cuePath.replace_extension(L".cue");
+			std::filesystem::path manifestPath = p;
+			manifestPath.replace_extension(L".tracks.json");
+			if (!AudioEnc::WriteCueSheet(cuePath, info) || !AudioEnc::WriteTrackManifest(manifestPath, oi->audio_rate, info)) {
+				LogWarn(L"cueシートまたはトラック一覧を書き込めません");
+			}
+			LogInfo(std::to_wstring(info.size()) + L" トラックに分割して出力しました");
+		}
+
+		if (analyzer) {
+			auto t0 = Clock::now();
+			AudioEnc::AnalyzerReport report = analyzer->Finish();
+			bool qcOk = isAborted || ReportQc(p, report, qcSettings);
+			AddStage(rec, "qc", elapsed(t0));
+			if (!qcOk && g_config.qc_fail) {
+				LogError(L"品質チェックに失敗したため出力を失敗扱いにします");
+				rec.error = "qc failed";
+				return false;
+			}
 		}
-		CloseHandle(pi.hProcess);
-		CloseHandle(pi.hThread);
 
 		return !isAborted;
 	}
+
+	bool OutputFunc(OUTPUT_INFO* oi) {
+		auto start = std::chrono::steady_clock::now();
+		AudioEnc::JournalRecord rec;
+		rec.settings = {
+			{ "mp3", g_config.mp3_bitrate }, { "opus", g_config.opus_bitrate }, { "ogg", g_config.ogg_bitrate },
+			{ "sr", g_config.samplerate }, { "flac", g_config.flac_level }, { "flac_bits", g_config.flac_bits },
+			{ "wav", g_config.wav_bitdepth }, { "mp3_auto", g_config.mp3_auto }, { "opus_auto", g_config.opus_auto },
+			{ "flac_auto", g_config.flac_auto }, { "qc", g_config.qc_enable }, { "verify", g_config.verify },
+			{ "split", g_config.split_mode }, { "pool_mb", g_config.pool_mb }, { "export_pool_mb", g_config.export_pool_mb },
+			{ "large_pages", g_config.large_pages }, { "fetch", g_config.fetch_mode }, { "fetch_bench", g_config.fetch_bench },
+		};
+
+		bool ok = RunExport(oi, rec);
+
+		if (g_config.journal) {
+			rec.version = ToUtf8(INFO_STR);
+			rec.file = oi->savefile;
+			rec.preset = ToUtf8(g_config.current_preset);
+			rec.audio_rate = oi->audio_rate;
+			rec.audio_ch = oi->audio_ch;
+			rec.audio_n = oi->audio_n;
+			rec.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			rec.ok = ok;
+
+			std::filesystem::path journal = GetIniPath();
+			journal.replace_extension(L".journal.jsonl");
+			if (!AudioEnc::AppendJournal(journal, rec, (uint64_t)g_config.journal_kb << 10, g_config.journal_files)) {
+				LogWarn(L"ジャーナルを書き込めません: " + journal.wstring());
+			}
+		}
+		return ok;
+	}
 }
 
 LPCWSTR GetConfigText() {
@@ -338,6 +891,15 @@ extern "C" {
         return &t;
     }
 
+    __declspec(dllexport) void UninitializePlugin() {
+        // 検証スレッドがDLLのコードを実行中にアンロードされないように待つ
+        AudioEnc::WaitBackgroundVerify();
+    }
+
+    __declspec(dllexport) void InitializeLogger(LOG_HANDLE* logger) {
+        g_logger = logger;
+    }
+
     __declspec(dllexport) bool InitializePlugin(DWORD version) {
         g_iniPath = GetIniPathFromDll();
         wchar_t last[128]{};
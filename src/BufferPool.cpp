@@ -0,0 +1,298 @@
+﻿#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#pragma comment(lib, "Advapi32.lib")
+#else
+#include <cstdlib>
+#endif
+#include <algorithm>
+#include <new>
+
+#include "BufferPool.h"
+
+namespace AudioEnc {
+
+	namespace {
+		constexpr size_t kBlockBytes = (size_t)64 << 10;    // 小さいクラスを切り出す単位 (VirtualAlloc の確保粒度)
+
+#ifdef _WIN32
+		// ラージページには SeLockMemoryPrivilege が必要。ユーザー権利として割り当てられていても
+		// プロセスのトークンでは無効になっているので、有効にしてから使う
+		bool EnableLockMemoryPrivilege() {
+			HANDLE token = NULL;
+			if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) return false;
+			TOKEN_PRIVILEGES tp{};
+			tp.PrivilegeCount = 1;
+			tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+			bool ok = LookupPrivilegeValueW(nullptr, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid) &&
+				AdjustTokenPrivileges(token, FALSE, &tp, 0, nullptr, nullptr) &&
+				GetLastError() == ERROR_SUCCESS;    // 権利が無ければ ERROR_NOT_ALL_ASSIGNED
+			CloseHandle(token);
+			return ok;
+		}
+
+		size_t LargePageSize() {
+			static const size_t size = EnableLockMemoryPrivilege() ? GetLargePageMinimum() : 0;
+			return size;
+		}
+
+		void* OsAlloc(size_t bytes, bool large) {
+			DWORD type = MEM_COMMIT | MEM_RESERVE | (large ? MEM_LARGE_PAGES : 0);
+			return VirtualAlloc(nullptr, bytes, type, PAGE_READWRITE);
+		}
+
+		void OsFree(void* p) {
+			VirtualFree(p, 0, MEM_RELEASE);
+		}
+#else
+		// ベンチマーク (tools/PoolBench) を Windows 以外でビルドするための代替
+		size_t LargePageSize() { return 0; }
+
+		void* OsAlloc(size_t bytes, bool) {
+			return std::aligned_alloc(4096, (bytes + 4095) & ~(size_t)4095);
+		}
+
+		void OsFree(void* p) {
+			std::free(p);
+		}
+#endif
+	}
+
+	PooledBuffer& PooledBuffer::operator=(PooledBuffer&& o) noexcept {
+		if (this != &o) {
+			Release();
+			owner_ = o.owner_;
+			data_ = o.data_;
+			size_ = o.size_;
+			capacity_ = o.capacity_;
+			cls_ = o.cls_;
+			carved_ = o.carved_;
+			holder_ = o.holder_;
+			o.owner_ = nullptr;
+			o.data_ = nullptr;
+			o.size_ = o.capacity_ = 0;
+		}
+		return *this;
+	}
+
+	void PooledBuffer::Release() {
+		if (owner_ && data_) owner_->Return(*this);
+		owner_ = nullptr;
+		data_ = nullptr;
+		size_ = capacity_ = 0;
+	}
+
+	void PooledBuffer::HandOff() {
+		if (owner_ && data_) owner_->pool_.HandOff(*owner_, *this);
+	}
+
+	PooledBuffer ExportBudget::Acquire(size_t bytes) {
+		PooledBuffer buf;
+		int cls = 0;
+		bool carved = false;
+		buf.data_ = pool_.Acquire(*this, bytes, cls, carved);
+		buf.owner_ = this;
+		buf.size_ = bytes;
+		buf.capacity_ = (cls < 0) ? bytes : (size_t)1 << (cls + BufferPool::kMinShift);
+		buf.cls_ = cls;
+		buf.carved_ = carved;
+		buf.holder_ = (cls < 0) ? std::thread::id() : std::this_thread::get_id();
+		return buf;
+	}
+
+	void ExportBudget::Return(PooledBuffer& buf) {
+		pool_.Return(*this, buf);
+	}
+
+	BufferPool& BufferPool::Instance() {
+		static BufferPool pool;
+		return pool;
+	}
+
+	void BufferPool::Configure(size_t global_limit, bool large_pages) {
+		std::lock_guard<std::mutex> lk(mutex_);
+		use_large_pages_ = large_pages;
+		large_page_size_ = large_pages ? LargePageSize() : 0;
+		if (large_page_size_ == 0) use_large_pages_ = false;
+
+		// 切り出し用ブロックはクラス毎に少なくとも1つ持ち続けるので、その分は予算に収まるようにする
+		// (2MB のラージページなら 4KB..1MB の 9 クラスで 18MB)
+		const size_t block = use_large_pages_ ? large_page_size_ : kBlockBytes;
+		size_t carvedFootprint = 0;
+		for (int cls = 0; cls < kClasses && ((size_t)1 << (cls + kMinShift)) < block; cls++) carvedFootprint += block;
+		global_limit_ = std::max(global_limit, carvedFootprint);
+		TrimLocked(global_limit_);
+		cv_.notify_all();
+	}
+
+	PoolStats BufferPool::Stats() const {
+		std::lock_guard<std::mutex> lk(mutex_);
+		return stats_;
+	}
+
+	void BufferPool::Trim() {
+		std::lock_guard<std::mutex> lk(mutex_);
+		TrimLocked(0);
+	}
+
+	void* BufferPool::Acquire(ExportBudget& budget, size_t bytes, int& cls, bool& carved) {
+		cls = 0;
+		carved = false;
+		while (cls < kClasses - 1 && ((size_t)1 << (cls + kMinShift)) < bytes) cls++;
+		const size_t slab = (size_t)1 << (cls + kMinShift);
+		if (slab < bytes) throw std::bad_alloc();
+
+		const auto self = std::this_thread::get_id();
+		std::unique_lock<std::mutex> lk(mutex_);
+
+		// 予算を超える間は返却を待つ (何も借りていない場合は1つだけ超過を許して止まらないようにする)
+		auto exportOk = [&] { return budget.in_use_ == 0 || budget.in_use_ + slab <= budget.limit_; };
+		auto globalOk = [&] { return stats_.bytes_in_use == 0 || stats_.bytes_in_use + slab <= global_limit_; };
+		auto fits = [&] { return exportOk() && globalOk(); };
+		// 超えている予算を使っているのが自分のバッファだけなら、待っても返ってこない
+		auto heldBySelf = [&](const std::map<std::thread::id, size_t>& held) {
+			auto it = held.find(self);
+			return it == held.end() ? (size_t)0 : it->second;
+		};
+		auto stuck = [&] {
+			return (!exportOk() && budget.in_use_ == heldBySelf(budget.held_)) ||
+				(!globalOk() && stats_.bytes_in_use == heldBySelf(held_));
+		};
+		if (!fits()) {
+			stats_.waits++;
+			budget.waits_++;
+			cv_.wait(lk, [&] { return fits() || stuck(); });
+		}
+		if (!fits()) {
+			// 予算の外で確保し、返却時にそのまま解放する
+			void* data = AllocateSlab(bytes, false);
+			if (!data) throw std::bad_alloc();
+			stats_.overflows++;
+			budget.overflows_++;
+			cls = -1;
+			return data;
+		}
+
+		void* data = nullptr;
+		// 切り出したスラブは解放できないので優先して使う
+		if (!carved_free_[cls].empty()) {
+			data = carved_free_[cls].back();
+			carved_free_[cls].pop_back();
+			carved = true;
+			stats_.reuses++;
+		}
+		else if (!free_[cls].empty()) {
+			data = free_[cls].back();
+			free_[cls].pop_back();
+			stats_.reuses++;
+		}
+		else {
+			// 空きスラブを含めて予算を超えるなら、使われていないスラブを先に返す
+			if (stats_.bytes_reserved - carved_bytes_ + slab > global_limit_) TrimLocked(global_limit_ > slab ? global_limit_ - slab : 0);
+			data = NewSlabLocked(cls, carved);
+			if (!data) throw std::bad_alloc();
+		}
+
+		stats_.acquires++;
+		stats_.bytes_in_use += slab;
+		stats_.peak_in_use = std::max(stats_.peak_in_use, stats_.bytes_in_use);
+		budget.acquires_++;
+		budget.in_use_ += slab;
+		budget.peak_in_use_ = std::max(budget.peak_in_use_, budget.in_use_);
+		budget.held_[self] += slab;
+		held_[self] += slab;
+		return data;
+	}
+
+	namespace {
+		void Unhold(std::map<std::thread::id, size_t>& held, std::thread::id holder, size_t bytes) {
+			auto it = held.find(holder);
+			if (it == held.end()) return;
+			if (it->second <= bytes) held.erase(it);
+			else it->second -= bytes;
+		}
+	}
+
+	void BufferPool::Return(ExportBudget& budget, PooledBuffer& buf) {
+		if (buf.cls_ < 0) {
+			FreeSlab(buf.data_);
+			return;
+		}
+		const size_t slab = (size_t)1 << (buf.cls_ + kMinShift);
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			(buf.carved_ ? carved_free_ : free_)[buf.cls_].push_back(buf.data_);
+			stats_.bytes_in_use -= slab;
+			budget.in_use_ -= slab;
+			Unhold(budget.held_, buf.holder_, slab);
+			Unhold(held_, buf.holder_, slab);
+			// 切り出した分は解放できないので、返せる分だけで判定する
+			if (!buf.carved_ && stats_.bytes_reserved - carved_bytes_ > global_limit_) TrimLocked(global_limit_);
+		}
+		cv_.notify_all();
+	}
+
+	void BufferPool::HandOff(ExportBudget& budget, PooledBuffer& buf) {
+		if (buf.cls_ < 0 || buf.holder_ == std::thread::id()) return;
+		const size_t slab = (size_t)1 << (buf.cls_ + kMinShift);
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			Unhold(budget.held_, buf.holder_, slab);
+			Unhold(held_, buf.holder_, slab);
+		}
+		buf.holder_ = std::thread::id();
+		// 待っているスレッドが「自分しか空けられない」状態でなくなったか見直せるように起こす
+		cv_.notify_all();
+	}
+
+	void* BufferPool::NewSlabLocked(int cls, bool& carved) {
+		const size_t slab = (size_t)1 << (cls + kMinShift);
+		// ラージページが使えればその単位、そうでなければ 64KB より小さいクラスはブロックから切り出す
+		const size_t block = use_large_pages_ ? large_page_size_ : kBlockBytes;
+		const size_t bytes = std::max(slab, block);
+
+		void* data = AllocateSlab(bytes, true);
+		if (!data) return nullptr;
+		stats_.allocations++;
+		stats_.bytes_reserved += bytes;
+		stats_.peak_reserved = std::max(stats_.peak_reserved, stats_.bytes_reserved);
+
+		carved = slab < bytes;
+		if (carved) {
+			// 切り出したスラブは個別に OS へ返せないので、ブロックごと Trim の対象外にする
+			carved_bytes_ += bytes;
+			for (size_t off = slab; off + slab <= bytes; off += slab) carved_free_[cls].push_back((uint8_t*)data + off);
+		}
+		return data;
+	}
+
+	void* BufferPool::AllocateSlab(size_t bytes, bool pooled) {
+		if (pooled && use_large_pages_ && bytes % large_page_size_ == 0) {
+			// 連続した物理メモリが足りないと失敗するので、その場合は以後通常のページを使う
+			void* p = OsAlloc(bytes, true);
+			if (p) {
+				stats_.large_pages = true;
+				return p;
+			}
+			use_large_pages_ = false;
+		}
+		return OsAlloc(bytes, false);
+	}
+
+	void BufferPool::FreeSlab(void* data) {
+		OsFree(data);
+	}
+
+	void BufferPool::TrimLocked(size_t target) {
+		// 大きいスラブから返す (切り出し用ブロックは数えない)
+		for (int cls = kClasses - 1; cls >= 0 && stats_.bytes_reserved - carved_bytes_ > target; cls--) {
+			const size_t slab = (size_t)1 << (cls + kMinShift);
+			auto& list = free_[cls];
+			while (!list.empty() && stats_.bytes_reserved - carved_bytes_ > target) {
+				FreeSlab(list.back());
+				list.pop_back();
+				stats_.bytes_reserved -= slab;
+			}
+		}
+	}
+}
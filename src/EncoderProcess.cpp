@@ -0,0 +1,95 @@
+﻿#define NOMINMAX
+#include <windows.h>
+
+#include "EncoderProcess.h"
+
+namespace AudioEnc {
+
+	EncoderProcess::~EncoderProcess() {
+		if (process_) Terminate();
+		if (pipe_) CloseHandle(pipe_);
+	}
+
+	bool EncoderProcess::Start(std::wstring cmdline, bool showWindow) {
+		// パイプの作成とプロセスの起動
+		HANDLE hPipeRead = NULL;
+		HANDLE hPipeWrite = NULL;
+		SECURITY_ATTRIBUTES saAttr = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE }; // ハンドル継承を許可
+		if (!CreatePipe(&hPipeRead, &hPipeWrite, &saAttr, 0)) {
+			return false;
+		}
+		SetHandleInformation(hPipeWrite, HANDLE_FLAG_INHERIT, 0);
+
+		start_ = std::chrono::steady_clock::now();
+		STARTUPINFOW si = { sizeof(si) };
+		PROCESS_INFORMATION pi = { 0 };
+		si.dwFlags = STARTF_USESTDHANDLES | STARTF_USESHOWWINDOW;
+		si.hStdInput = hPipeRead;
+		si.hStdOutput = NULL;
+		si.hStdError = NULL;
+		si.wShowWindow = showWindow ? SW_SHOWNORMAL : SW_HIDE;
+		BOOL processCreated = CreateProcessW(NULL, cmdline.empty() ? NULL : cmdline.data(), NULL, NULL, TRUE,
+			showWindow ? 0 : CREATE_NO_WINDOW, NULL, NULL, &si, &pi);
+		CloseHandle(hPipeRead);
+		if (!processCreated) {
+			CloseHandle(hPipeWrite);
+			return false;
+		}
+		process_ = pi.hProcess;
+		thread_ = pi.hThread;
+		pipe_ = hPipeWrite;
+		return true;
+	}
+
+	bool EncoderProcess::Write(const void* data, size_t bytes) {
+		if (!pipe_ || broken_) return false;
+		DWORD bytesWritten = 0;
+		auto t0 = std::chrono::steady_clock::now();
+		BOOL ok = WriteFile(pipe_, data, (DWORD)bytes, &bytesWritten, NULL);
+		write_seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		if (!ok) {
+			// ffmpeg 側が途中で落ちた、または終了した場合
+			broken_ = true;
+			return false;
+		}
+		bytes_written_ += bytesWritten;
+		return true;
+	}
+
+	void EncoderProcess::CloseInput() {
+		if (pipe_) {
+			CloseHandle(pipe_);
+			pipe_ = NULL;
+		}
+	}
+
+	DWORD EncoderProcess::Wait() {
+		CloseInput();
+		DWORD exitCode = 0;
+		if (process_) {
+			WaitForSingleObject(process_, INFINITE);
+			GetExitCodeProcess(process_, &exitCode);
+			CloseHandle(process_);
+			CloseHandle(thread_);
+			process_ = thread_ = NULL;
+			end_ = std::chrono::steady_clock::now();
+		}
+		return exitCode;
+	}
+
+	void EncoderProcess::Terminate() {
+		CloseInput();
+		if (process_) {
+			TerminateProcess(process_, 0);
+			CloseHandle(process_);
+			CloseHandle(thread_);
+			process_ = thread_ = NULL;
+			end_ = std::chrono::steady_clock::now();
+		}
+	}
+
+	double EncoderProcess::Seconds() const {
+		auto end = process_ ? std::chrono::steady_clock::now() : end_;
+		return std::chrono::duration<double>(end - start_).count();
+	}
+}
@@ -0,0 +1,107 @@
+﻿#define NOMINMAX
+#include <windows.h>
+#include <algorithm>
+
+#include "EncoderTuner.h"
+#include "EncoderProcess.h"
+
+namespace AudioEnc {
+
+	namespace {
+		const wchar_t* kSection = L"AutoTune";
+
+		std::wstring Widen(const std::string& s) {
+			return std::wstring(s.begin(), s.end());
+		}
+	}
+
+	EncoderTuner::EncoderTuner(TuneTarget target, std::filesystem::path profile, int rate, int channels, int out_rate)
+		: target_(std::move(target)), profile_(std::move(profile)), rate_(rate), channels_(channels), out_rate_(out_rate) {
+	}
+
+	std::wstring EncoderTuner::ProfileKey(const std::wstring& codec) const {
+		return codec + L"_" + std::to_wstring(rate_) + L"_" + std::to_wstring(channels_) + L"_" + std::to_wstring(out_rate_);
+	}
+
+	double EncoderTuner::Throughput(int level) const {
+		std::wstring key = ProfileKey(target_.key + std::to_wstring(level));
+		return (double)GetPrivateProfileIntW(kSection, key.c_str(), 0, profile_.wstring().c_str());
+	}
+
+	void EncoderTuner::SetThroughput(int level, double fps) {
+		std::wstring key = ProfileKey(target_.key + std::to_wstring(level));
+		long long v = std::clamp<long long>((long long)fps, 1, 0x7fffffff);
+		WritePrivateProfileStringW(kSection, key.c_str(), std::to_wstring(v).c_str(), profile_.wstring().c_str());
+	}
+
+	/// <summary>
+	/// 先頭部分を ffmpeg でエンコードして出力を捨て、かかった時間を返す (失敗したら 0)
+	/// </summary>
+	double EncoderTuner::Calibrate(const CalibrationData& data, const std::string& codecArgs) const {
+		std::string cmd = "ffmpeg -v error -threads 0 -y " + data.input_args +
+			" -i - -ar " + std::to_string(data.out_rate) + " " + codecArgs + " -f null -";
+
+		EncoderProcess enc;
+		if (!enc.Start(Widen(cmd), false)) return 0.0;
+		for (auto& [ptr, bytes] : data.chunks) {
+			if (!enc.Write(ptr, bytes)) break;
+		}
+		if (enc.Wait() != 0 || enc.Broken()) return 0.0;
+		return enc.Seconds();
+	}
+
+	double EncoderTuner::StartupSeconds(const CalibrationData& data) {
+		if (startup_ >= 0.0) return startup_;
+		std::wstring key = ProfileKey(L"startup_us");
+		UINT us = GetPrivateProfileIntW(kSection, key.c_str(), 0, profile_.wstring().c_str());
+		if (us == 0) {
+			// エンコードをほぼ行わない PCM 出力の時間を起動・転送のコストとみなす
+			double sec = Calibrate(data, "-c:a pcm_f32le");
+			us = (UINT)std::max(1.0, sec * 1e6);
+			WritePrivateProfileStringW(kSection, key.c_str(), std::to_wstring(us).c_str(), profile_.wstring().c_str());
+		}
+		startup_ = us / 1e6;
+		return startup_;
+	}
+
+	int EncoderTuner::Choose(double render_fps, const CalibrationData& data, const CodecArgsFunc& codecArgs) {
+		const double need = render_fps * kMargin;
+		for (auto it = target_.levels.rbegin(); it != target_.levels.rend(); ++it) {
+			double fps = Throughput(*it);
+			if (fps <= 0.0 && data.frames > 0) {
+				double sec = Calibrate(data, codecArgs(*it));
+				if (sec > 0.0) {
+					// 起動時間のばらつきで極端な値にならないよう、差し引くのは全体の 9 割までにする
+					fps = (double)data.frames / std::max(sec - StartupSeconds(data), sec * 0.1);
+					SetThroughput(*it, fps);
+				}
+			}
+			if (fps >= need) return *it;
+		}
+		return target_.levels.front();
+	}
+
+	int EncoderTuner::Reevaluate(int level, double render_fps, double encoder_fps, bool encoder_bound) {
+		// 律速していたなら、観測した速度がその設定の実力 (描画と CPU を取り合った状態) とみなして上下どちらにも寄せる。
+		// 律速していなければ実力は観測した速度以上なので、それより低い値だけ引き上げる
+		if (encoder_fps > 0.0) {
+			double cur = Throughput(level);
+			if (cur <= 0.0) {
+				if (encoder_bound) SetThroughput(level, encoder_fps);
+			}
+			else if (encoder_bound || encoder_fps > cur) {
+				SetThroughput(level, cur + (encoder_fps - cur) * kBlend);
+			}
+		}
+		return Pick(render_fps);
+	}
+
+	int EncoderTuner::Pick(double render_fps) const {
+		const double need = render_fps * kMargin;
+		for (auto it = target_.levels.rbegin(); it != target_.levels.rend(); ++it) {
+			double fps = Throughput(*it);
+			if (fps > 0.0 && fps >= need) return *it;
+		}
+		return target_.levels.front();
+	}
+}
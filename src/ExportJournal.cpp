@@ -0,0 +1,196 @@
+﻿#define NOMINMAX
+#include <windows.h>
+#include <cwchar>
+#include <cwctype>
+#include <mutex>
+
+#include "ExportJournal.h"
+#include "JsonText.h"
+
+namespace AudioEnc {
+
+	namespace {
+		std::mutex g_journalMutex;
+		constexpr int kOpenRetries = 20;
+		constexpr DWORD kOpenRetryMs = 50;
+		constexpr DWORD kLockTimeoutMs = 5000;
+
+		/// <summary>
+		/// 同じジャーナルに書く他のプロセスとの排他 (パスから作った名前付きミューテックス)
+		/// </summary>
+		/// <description>
+		/// サイズの確認からローテーション・追記までを囲み、複数のプロセスが同時に上限を超えたと判断して
+		/// 二重にローテーションする (古い世代が早く消える) のを防ぐ。
+		/// </description>
+		class JournalLock {
+		public:
+			explicit JournalLock(const std::filesystem::path& path) {
+				// ミューテックス名に '\' は使えないので、大文字小文字を無視したパスのハッシュを名前にする
+				uint64_t h = 0xcbf29ce484222325ULL;
+				for (wchar_t c : path.wstring()) h = (h ^ (uint64_t)std::towlower(c)) * 0x100000001b3ULL;
+				wchar_t name[64];
+				swprintf(name, 64, L"Local\\AudioEnc.journal.%016llx", (unsigned long long)h);
+				mutex_ = CreateMutexW(nullptr, FALSE, name);
+				if (mutex_) {
+					// 持ち主のプロセスが落ちた場合 (WAIT_ABANDONED) も所有権は得られる
+					DWORD r = WaitForSingleObject(mutex_, kLockTimeoutMs);
+					owned_ = (r == WAIT_OBJECT_0 || r == WAIT_ABANDONED);
+				}
+			}
+
+			~JournalLock() {
+				if (owned_) ReleaseMutex(mutex_);
+				if (mutex_) CloseHandle(mutex_);
+			}
+
+			JournalLock(const JournalLock&) = delete;
+			JournalLock& operator=(const JournalLock&) = delete;
+
+			bool Owned() const { return owned_; }
+
+		private:
+			HANDLE mutex_ = NULL;
+			bool owned_ = false;
+		};
+
+		std::string UtcTimestamp() {
+			SYSTEMTIME st{};
+			GetSystemTime(&st);
+			char buf[32];
+			snprintf(buf, sizeof(buf), "%04u-%02u-%02uT%02u:%02u:%02uZ",
+				st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+			return buf;
+		}
+
+		std::filesystem::path Generation(const std::filesystem::path& path, int n) {
+			std::filesystem::path p = path;
+			p += L"." + std::to_wstring(n);
+			return p;
+		}
+
+		void Rotate(const std::filesystem::path& path, int keep) {
+			DeleteFileW(Generation(path, keep).wstring().c_str());
+			for (int n = keep - 1; n >= 1; n--) {
+				MoveFileExW(Generation(path, n).wstring().c_str(), Generation(path, n + 1).wstring().c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+			}
+			if (keep >= 1) MoveFileExW(path.wstring().c_str(), Generation(path, 1).wstring().c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+			else DeleteFileW(path.wstring().c_str());
+		}
+
+		// 別のプロセス (AviUtl2 の複数起動など) も同じジャーナルに追記するので、書き込みも共有して開く
+		// (追記とローテーションは JournalLock で直列化する)。
+		// 共有しない相手 (ウイルス対策ソフトなど) が一時的に開いている場合は少し待って開き直す
+		HANDLE OpenJournal(const std::filesystem::path& path) {
+			for (int i = 0;; i++) {
+				HANDLE h = CreateFileW(path.wstring().c_str(), GENERIC_READ | FILE_APPEND_DATA,
+					FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+				if (h != INVALID_HANDLE_VALUE || GetLastError() != ERROR_SHARING_VIOLATION || i + 1 >= kOpenRetries) return h;
+				Sleep(kOpenRetryMs);
+			}
+		}
+
+		// 末尾が改行で終わっていなければ true (前回の書き込みが途中で切れている)
+		bool EndsTorn(HANDLE h, int64_t size) {
+			if (size <= 0) return false;
+			LARGE_INTEGER pos;
+			pos.QuadPart = size - 1;
+			char last = '\n';
+			DWORD read = 0;
+			if (!SetFilePointerEx(h, pos, nullptr, FILE_BEGIN) || !ReadFile(h, &last, 1, &read, nullptr)) return false;
+			return read == 1 && last != '\n';
+		}
+	}
+
+	void AddStage(JournalRecord& rec, const std::string& name, double seconds) {
+		for (auto& [n, s] : rec.stages) {
+			if (n == name) {
+				s += seconds;
+				return;
+			}
+		}
+		rec.stages.emplace_back(name, seconds);
+	}
+
+	std::string FormatJournalLine(const JournalRecord& rec) {
+		std::string s = "{\"v\":1,\"time\":";
+		AppendJsonString(s, UtcTimestamp());
+		s += ",\"version\":";
+		AppendJsonString(s, rec.version);
+		s += ",\"file\":";
+		AppendJsonString(s, PathToUtf8(rec.file));
+		s += ",\"format\":";
+		AppendJsonString(s, rec.format);
+		s += ",\"preset\":";
+		AppendJsonString(s, rec.preset);
+		s += ",\"settings\":{";
+		for (size_t i = 0; i < rec.settings.size(); i++) {
+			if (i) s += ',';
+			AppendJsonString(s, rec.settings[i].first);
+			s += ':';
+			AppendJsonNumber(s, rec.settings[i].second);
+		}
+		s += "},\"fetch\":";
+		AppendJsonString(s, rec.fetch);
+		s += ",\"audio_rate\":";
+		AppendJsonNumber(s, (int64_t)rec.audio_rate);
+		s += ",\"audio_ch\":";
+		AppendJsonNumber(s, (int64_t)rec.audio_ch);
+		s += ",\"audio_n\":";
+		AppendJsonNumber(s, rec.audio_n);
+		s += ",\"wall_s\":";
+		AppendJsonNumber(s, rec.wall_seconds);
+		s += ",\"stages\":{";
+		for (size_t i = 0; i < rec.stages.size(); i++) {
+			if (i) s += ',';
+			AppendJsonString(s, rec.stages[i].first);
+			s += ':';
+			AppendJsonNumber(s, rec.stages[i].second);
+		}
+		s += "},\"pipe_bytes\":";
+		AppendJsonNumber(s, (int64_t)rec.pipe_bytes);
+		s += ",\"output_bytes\":";
+		AppendJsonNumber(s, (int64_t)rec.output_bytes);
+		s += ",\"tracks\":";
+		AppendJsonNumber(s, (int64_t)rec.tracks);
+		s += ",\"exit_code\":";
+		AppendJsonNumber(s, rec.exit_code);
+		s += ",\"aborted\":";
+		s += rec.aborted ? "true" : "false";
+		s += ",\"ok\":";
+		s += rec.ok ? "true" : "false";
+		s += ",\"error\":";
+		AppendJsonString(s, rec.error);
+		s += '}';
+		return s;
+	}
+
+	bool AppendJournal(const std::filesystem::path& path, const JournalRecord& rec, uint64_t max_bytes, int keep) {
+		std::string line = FormatJournalLine(rec);
+		line += '\n';
+
+		std::lock_guard<std::mutex> lk(g_journalMutex);
+		JournalLock lock(path);
+		if (!lock.Owned()) return false;
+		for (int attempt = 0; attempt < 2; attempt++) {
+			HANDLE h = OpenJournal(path);
+			if (h == INVALID_HANDLE_VALUE) return false;
+
+			LARGE_INTEGER size{};
+			GetFileSizeEx(h, &size);
+			if (attempt == 0 && size.QuadPart > 0 && (uint64_t)size.QuadPart + line.size() > max_bytes) {
+				CloseHandle(h);
+				Rotate(path, keep);
+				continue;
+			}
+
+			std::string data = EndsTorn(h, size.QuadPart) ? "\n" + line : line;
+			DWORD written = 0;
+			// FILE_APPEND_DATA のみなのでファイルポインタに関係なく末尾に書かれる
+			BOOL ok = WriteFile(h, data.data(), (DWORD)data.size(), &written, nullptr) && written == data.size();
+			ok = FlushFileBuffers(h) && ok;
+			CloseHandle(h);
+			return ok;
+		}
+		return false;
+	}
+}
@@ -0,0 +1,456 @@
+﻿#define NOMINMAX
+#include <windows.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#include "ExportVerifier.h"
+#include "BufferPool.h"
+
+namespace AudioEnc {
+
+	namespace {
+		constexpr uint64_t kHashSeed = 0xcbf29ce484222325ULL;
+		constexpr uint64_t kHashPrime = 0x100000001b3ULL;
+		constexpr size_t kVerifyBudget = (size_t)16 << 20;
+
+		inline void HashAdd(uint64_t& h, int32_t v) {
+			h = (h ^ (uint32_t)v) * kHashPrime;
+		}
+
+		// libswresample の flt -> s16 / s32 変換 (C 版) と同じ結果になるように量子化する
+		// s32 の正側の飽和値は SIMD 版 (2147483520) と異なるため、32bit は完全一致の検証に使わない。
+		// 24bit は s32 >> 8 なのでどちらでも同じ値になる
+		inline int32_t QuantizeS16(float x) {
+			return (int32_t)std::clamp<long long>(llrintf(x * 32768.0f), -32768, 32767);
+		}
+
+		inline int32_t QuantizeS32(float x) {
+			return (int32_t)std::clamp<long long>(llrintf(x * 2147483648.0f), INT32_MIN, INT32_MAX);
+		}
+
+		/// <summary>
+		/// ffmpeg を起動し、標準出力に書き出されたデータを sink に渡す
+		/// </summary>
+		/// <returns>ffmpeg の終了コード (起動できなければ -1)</returns>
+		long RunDecoder(ExportBudget& budget, const std::wstring& args, const std::function<void(const uint8_t*, size_t)>& sink) {
+			HANDLE hRead = NULL;
+			HANDLE hWrite = NULL;
+			SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+			if (!CreatePipe(&hRead, &hWrite, &sa, 1 << 20)) return -1;
+			SetHandleInformation(hRead, HANDLE_FLAG_INHERIT, 0);
+
+			STARTUPINFOW si = { sizeof(si) };
+			PROCESS_INFORMATION pi = { 0 };
+			si.dwFlags = STARTF_USESTDHANDLES | STARTF_USESHOWWINDOW;
+			si.hStdInput = NULL;
+			si.hStdOutput = hWrite;
+			si.hStdError = NULL;
+			si.wShowWindow = SW_HIDE;
+			std::wstring cmd = L"ffmpeg -v error -nostdin " + args;
+			BOOL created = CreateProcessW(NULL, cmd.data(), NULL, NULL, TRUE, CREATE_NO_WINDOW, NULL, NULL, &si, &pi);
+			CloseHandle(hWrite);
+			if (!created) {
+				CloseHandle(hRead);
+				return -1;
+			}
+
+			PooledBuffer buf = budget.Acquire(1 << 20);
+			DWORD readBytes = 0;
+			while (ReadFile(hRead, buf.Data(), (DWORD)buf.Size(), &readBytes, NULL) && readBytes > 0) {
+				sink(buf.As<uint8_t>(), readBytes);
+			}
+			CloseHandle(hRead);
+
+			DWORD exitCode = 0;
+			WaitForSingleObject(pi.hProcess, INFINITE);
+			GetExitCodeProcess(pi.hProcess, &exitCode);
+			CloseHandle(pi.hProcess);
+			CloseHandle(pi.hThread);
+			return (long)exitCode;
+		}
+
+		// パイプから読んだバイト列を sampleBytes 単位に揃えて渡す
+		class SampleAssembler {
+		public:
+			explicit SampleAssembler(size_t frameBytes) : frame_bytes_(frameBytes) {}
+
+			template <class F>
+			void Feed(const uint8_t* data, size_t size, F&& onFrames) {
+				if (!pending_.empty()) {
+					size_t need = frame_bytes_ - pending_.size();
+					size_t take = std::min(need, size);
+					pending_.insert(pending_.end(), data, data + take);
+					data += take;
+					size -= take;
+					if (pending_.size() < frame_bytes_) return;
+					onFrames(pending_.data(), (size_t)1);
+					pending_.clear();
+				}
+				size_t frames = size / frame_bytes_;
+				if (frames > 0) onFrames(data, frames);
+				pending_.assign(data + frames * frame_bytes_, data + size);
+			}
+
+		private:
+			size_t frame_bytes_;
+			std::vector<uint8_t> pending_;
+		};
+
+		std::wstring ToWide(const std::string& s) {
+			return std::wstring(s.begin(), s.end());
+		}
+
+		std::wstring HashText(uint64_t h) {
+			wchar_t buf[20];
+			swprintf(buf, 20, L"%016llx", (unsigned long long)h);
+			return buf;
+		}
+
+		VerifyResult CompareExact(const PcmDigest& d, int bits, int64_t frames, uint64_t hash, uint64_t bytes) {
+			VerifyResult r;
+			r.bytes_decoded = bytes;
+			if (frames != d.Frames()) {
+				r.message = L"サンプル数が一致しません (期待 " + std::to_wstring(d.Frames()) + L", 実際 " + std::to_wstring(frames) + L")";
+				return r;
+			}
+			if (hash != d.Hash(bits)) {
+				r.message = L"PCMハッシュが一致しません (" + std::to_wstring(bits) + L"bit, 期待 " + HashText(d.Hash(bits)) + L", 実際 " + HashText(hash) + L")";
+				return r;
+			}
+			r.ok = true;
+			r.message = L"PCMハッシュ一致 (" + std::to_wstring(bits) + L"bit, " + std::to_wstring(frames) + L" サンプル)";
+			return r;
+		}
+
+		VerifyResult VerifyApprox(const VerifyJob& job, ExportBudget& budget);
+
+		/// <summary>
+		/// WAV を自前で読み込み、PCMハッシュを比較する
+		/// </summary>
+		VerifyResult VerifyWav(const VerifyJob& job, ExportBudget& budget) {
+			const PcmDigest& d = *job.digest;
+			VerifyResult r;
+			std::ifstream f(job.file, std::ios::binary);
+			char riff[12];
+			if (!f.read(riff, 12) || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+				r.message = L"WAVヘッダが不正です";
+				return r;
+			}
+
+			int format = 0, channels = 0, bits = 0;
+			uint64_t dataSize = 0;
+			bool haveData = false;
+			while (!haveData) {
+				char id[4];
+				uint32_t size = 0;
+				if (!f.read(id, 4) || !f.read((char*)&size, 4)) break;
+				if (memcmp(id, "fmt ", 4) == 0) {
+					std::vector<uint8_t> fmt(size);
+					f.read((char*)fmt.data(), size);
+					if (size >= 16) {
+						format = fmt[0] | (fmt[1] << 8);
+						channels = fmt[2] | (fmt[3] << 8);
+						bits = fmt[14] | (fmt[15] << 8);
+						// WAVE_FORMAT_EXTENSIBLE はサブフォーマットの先頭2バイトを見る
+						if (format == 0xFFFE && size >= 26) format = fmt[24] | (fmt[25] << 8);
+					}
+				}
+				else if (memcmp(id, "data", 4) == 0) {
+					dataSize = size;
+					haveData = true;
+				}
+				else {
+					f.seekg(size + (size & 1), std::ios::cur);
+				}
+			}
+			if (!haveData || format != 1 || channels != d.Channels() || (bits != 16 && bits != 24 && bits != 32)) {
+				return VerifyApprox(job, budget);
+			}
+
+			// 4GBを超えた場合などサイズが壊れていることがあるので、ファイル末尾までを上限とする
+			auto dataStart = f.tellg();
+			f.seekg(0, std::ios::end);
+			uint64_t remain = (uint64_t)(f.tellg() - dataStart);
+			f.seekg(dataStart);
+			if (dataSize == 0xFFFFFFFFu || dataSize > remain) dataSize = remain;
+
+			const size_t sampleBytes = bits / 8;
+			const size_t frameBytes = sampleBytes * channels;
+			uint64_t hash = kHashSeed;
+			int64_t frames = 0;
+			PooledBuffer buf = budget.Acquire(frameBytes * 65536);
+			while (dataSize >= frameBytes) {
+				size_t want = (size_t)std::min<uint64_t>(buf.Size(), dataSize - dataSize % frameBytes);
+				if (!f.read(buf.As<char>(), (std::streamsize)want)) break;
+				dataSize -= want;
+				const uint8_t* p = buf.As<uint8_t>();
+				size_t n = want / sampleBytes;
+				for (size_t i = 0; i < n; i++, p += sampleBytes) {
+					int32_t v;
+					if (bits == 16) v = (int16_t)(p[0] | (p[1] << 8));
+					else if (bits == 24) v = ((int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24)) >> 8;
+					else memcpy(&v, p, 4);
+					HashAdd(hash, v);
+				}
+				frames += (int64_t)(want / frameBytes);
+			}
+			return CompareExact(d, bits, frames, hash, (uint64_t)frames * frameBytes);
+		}
+
+		/// <summary>
+		/// FLAC の STREAMINFO からビット深度を読み、ffmpeg でデコードした PCM のハッシュを比較する
+		/// </summary>
+		VerifyResult VerifyFlac(const VerifyJob& job, ExportBudget& budget) {
+			const PcmDigest& d = *job.digest;
+			VerifyResult r;
+			uint8_t head[42];
+			{
+				std::ifstream f(job.file, std::ios::binary);
+				if (!f.read((char*)head, sizeof(head)) || memcmp(head, "fLaC", 4) != 0 || (head[4] & 0x7F) != 0) {
+					r.message = L"FLACヘッダが不正です";
+					return r;
+				}
+			}
+			const uint8_t* info = head + 8;
+			int channels = ((info[12] >> 1) & 7) + 1;
+			int bits = (((info[12] & 1) << 4) | (info[13] >> 4)) + 1;
+			int64_t total = ((int64_t)(info[13] & 0x0F) << 32) | ((int64_t)info[14] << 24) | (info[15] << 16) | (info[16] << 8) | info[17];
+			if (channels != d.Channels() || (bits != 16 && bits != 24 && bits != 32)) {
+				return VerifyApprox(job, budget);
+			}
+
+			const int shift = 32 - bits;
+			uint64_t hash = kHashSeed;
+			int64_t frames = 0;
+			uint64_t bytes = 0;
+			SampleAssembler assembler(4 * (size_t)channels);
+			long exitCode = RunDecoder(budget, L"-i \"" + job.file.wstring() + L"\" -f s32le -", [&](const uint8_t* data, size_t size) {
+				bytes += size;
+				assembler.Feed(data, size, [&](const uint8_t* p, size_t n) {
+					const int32_t* s = (const int32_t*)p;
+					for (size_t i = 0; i < n * channels; i++) HashAdd(hash, s[i] >> shift);
+					frames += (int64_t)n;
+				});
+			});
+			if (exitCode != 0) {
+				r.message = L"デコードに失敗しました (ffmpeg 終了コード " + std::to_wstring(exitCode) + L")";
+				return r;
+			}
+			if (total != 0 && total != frames) {
+				r.message = L"STREAMINFOのサンプル数 (" + std::to_wstring(total) + L") とデコード結果 (" + std::to_wstring(frames) + L") が一致しません";
+				return r;
+			}
+			return CompareExact(d, bits, frames, hash, bytes);
+		}
+
+		/// <summary>
+		/// ffmpeg で元のサンプリングレートに戻してデコードし、サンプル数と帯域エネルギーの誤差を比較する
+		/// </summary>
+		VerifyResult VerifyApprox(const VerifyJob& job, ExportBudget& budget) {
+			const PcmDigest& d = *job.digest;
+			VerifyResult r;
+			const int ch = d.Channels();
+			SpectralFingerprint fp(d.Rate(), ch);
+			int64_t frames = 0;
+			SampleAssembler assembler(sizeof(float) * (size_t)ch);
+			long exitCode = RunDecoder(budget, L"-i \"" + job.file.wstring() + L"\" -f f32le -ar " + std::to_wstring(d.Rate()) +
+				L" -ac " + std::to_wstring(ch) + L" -", [&](const uint8_t* data, size_t size) {
+				r.bytes_decoded += size;
+				assembler.Feed(data, size, [&](const uint8_t* p, size_t n) {
+					fp.Update((const float*)p, (int)n);
+					frames += (int64_t)n;
+				});
+			});
+			if (exitCode != 0) {
+				r.message = L"デコードに失敗しました (ffmpeg 終了コード " + std::to_wstring(exitCode) + L")";
+				return r;
+			}
+
+			// エンコーダの遅延補正やリサンプルで多少ずれるので 50ms までは許容する
+			int64_t tolerance = std::max<int64_t>(d.Rate() / 20, SpectralFingerprint::kBlock);
+			if (std::llabs(frames - d.Frames()) > tolerance) {
+				r.message = L"サンプル数が一致しません (期待 " + std::to_wstring(d.Frames()) + L", 実際 " + std::to_wstring(frames) + L")";
+				return r;
+			}
+
+			double errorDb = 0.0;
+			if (const SpectralFingerprint* ref = d.Fingerprint()) {
+				const auto& a = ref->Bands();
+				const auto& b = fp.Bands();
+				size_t n = std::min(a.size(), b.size());
+				float peak = -200.0f;
+				for (size_t i = 0; i < n; i++) peak = std::max(peak, a[i]);
+				// 最大値から 50dB 以内の帯域だけを比較対象にする (無音部分の量子化ノイズは無視)
+				double sum = 0.0;
+				size_t count = 0;
+				for (size_t i = 0; i < n; i++) {
+					if (a[i] < peak - 50.0f) continue;
+					sum += std::fabs(a[i] - b[i]);
+					count++;
+				}
+				errorDb = (count > 0) ? sum / (double)count : 0.0;
+			}
+			wchar_t buf[32];
+			swprintf(buf, 32, L"%.2f", errorDb);
+			if (errorDb > job.max_spectral_error_db) {
+				r.message = std::wstring(L"帯域エネルギーの誤差が大きすぎます (平均 ") + buf + L" dB)";
+				return r;
+			}
+			r.ok = true;
+			r.message = std::wstring(L"サンプル数 ") + std::to_wstring(frames) + L", 帯域エネルギー誤差 " + buf + L" dB";
+			return r;
+		}
+
+		std::mutex g_verifyMutex;
+		std::condition_variable g_verifyCv;
+		// 検証は1本のワーカーで順に実行する (分割出力でデコーダを同時に何本も起動しない)
+		std::deque<std::pair<VerifyJob, std::function<void(const VerifyJob&, const VerifyResult&)>>> g_verifyQueue;
+		bool g_verifyRunning = false;
+		std::thread g_verifyWorker;     // 終了後も join するまで保持する
+
+		void VerifyWorker() {
+			std::unique_lock<std::mutex> lk(g_verifyMutex);
+			while (!g_verifyQueue.empty()) {
+				{
+					// ダイジェストや done が持つものは、完了を知らせる前にこのスレッドで破棄する
+					auto [job, done] = std::move(g_verifyQueue.front());
+					g_verifyQueue.pop_front();
+					lk.unlock();
+					VerifyResult r;
+					try {
+						r = VerifyOutput(job);
+					}
+					catch (const std::exception& e) {
+						r.ok = false;
+						r.message = L"検証中に例外が発生しました: " + ToWide(e.what());
+					}
+					done(job, r);
+				}
+				lk.lock();
+			}
+			g_verifyRunning = false;
+			lk.unlock();
+			g_verifyCv.notify_all();
+		}
+	}
+
+	SpectralFingerprint::SpectralFingerprint(int rate, int channels)
+		: channels_(channels), window_(kBlock), twiddle_(kBlock / 2), work_(kBlock) {
+		const double pi = 3.14159265358979323846;
+		for (int i = 0; i < kBlock; i++) window_[i] = (float)(0.5 - 0.5 * std::cos(2.0 * pi * i / kBlock));
+		for (int i = 0; i < kBlock / 2; i++) twiddle_[i] = std::polar(1.0f, (float)(-2.0 * pi * i / kBlock));
+
+		// 非可逆コーデックが削りやすい高域は比較しない
+		const int edges[kBands + 1] = { 50, 150, 300, 600, 1200, 2400, 4800, 8000 };
+		for (int b = 0; b <= kBands; b++) {
+			band_bin_[b] = std::clamp((int)std::lround((double)edges[b] * kBlock / rate), 1, kBlock / 2);
+		}
+		block_.reserve(kBlock);
+	}
+
+	void SpectralFingerprint::Update(const float* data, int frames) {
+		const float scale = 1.0f / channels_;
+		for (int f = 0; f < frames; f++) {
+			const float* s = data + (size_t)f * channels_;
+			float m = 0.0f;
+			for (int c = 0; c < channels_; c++) m += s[c];
+			block_.push_back(m * scale);
+			if ((int)block_.size() == kBlock) Flush();
+		}
+	}
+
+	void SpectralFingerprint::Flush() {
+		// ビット反転順に並べてから基数2のFFT
+		for (int i = 0, j = 0; i < kBlock; i++) {
+			work_[j] = { block_[i] * window_[i], 0.0f };
+			for (int bit = kBlock >> 1; (j ^= bit) < bit; bit >>= 1) {}
+		}
+		for (int len = 2; len <= kBlock; len <<= 1) {
+			const int step = kBlock / len;
+			for (int i = 0; i < kBlock; i += len) {
+				for (int k = 0; k < len / 2; k++) {
+					auto t = work_[i + k + len / 2] * twiddle_[k * step];
+					work_[i + k + len / 2] = work_[i + k] - t;
+					work_[i + k] += t;
+				}
+			}
+		}
+		for (int b = 0; b < kBands; b++) {
+			double e = 0.0;
+			for (int k = band_bin_[b]; k < band_bin_[b + 1]; k++) e += std::norm(work_[k]);
+			bands_.push_back((float)(10.0 * std::log10(e + 1e-12)));
+		}
+		block_.clear();
+	}
+
+	PcmDigest::PcmDigest(int rate, int channels, bool fingerprint)
+		: rate_(rate), channels_(channels), h16_(kHashSeed), h24_(kHashSeed), h32_(kHashSeed) {
+		if (fingerprint) fingerprint_ = std::make_unique<SpectralFingerprint>(rate, channels);
+	}
+
+	void PcmDigest::Update(const float* data, int frames) {
+		const size_t n = (size_t)frames * channels_;
+		for (size_t i = 0; i < n; i++) {
+			int32_t s32 = QuantizeS32(data[i]);
+			HashAdd(h16_, QuantizeS16(data[i]));
+			HashAdd(h24_, s32 >> 8);
+			HashAdd(h32_, s32);
+		}
+		if (fingerprint_) fingerprint_->Update(data, frames);
+		frames_ += frames;
+	}
+
+	uint64_t PcmDigest::Hash(int bits) const {
+		switch (bits) {
+		case 16: return h16_;
+		case 24: return h24_;
+		case 32: return h32_;
+		}
+		return 0;
+	}
+
+	VerifyResult VerifyOutput(const VerifyJob& job) {
+		auto t0 = std::chrono::steady_clock::now();
+		ExportBudget budget(BufferPool::Instance(), kVerifyBudget);
+		VerifyResult r;
+		if (!std::filesystem::exists(job.file)) {
+			r.message = L"出力ファイルがありません";
+		}
+		else if (job.exact && job.ext == ".wav") {
+			r = VerifyWav(job, budget);
+		}
+		else if (job.exact && job.ext == ".flac") {
+			r = VerifyFlac(job, budget);
+		}
+		else {
+			r = VerifyApprox(job, budget);
+		}
+		r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		return r;
+	}
+
+	void StartBackgroundVerify(VerifyJob job, std::function<void(const VerifyJob&, const VerifyResult&)> done) {
+		std::lock_guard<std::mutex> lk(g_verifyMutex);
+		g_verifyQueue.emplace_back(std::move(job), std::move(done));
+		if (g_verifyRunning) return;
+
+		// 前のワーカーはキューを空にして抜けたところなので、すぐに join できる
+		if (g_verifyWorker.joinable()) g_verifyWorker.join();
+		g_verifyRunning = true;
+		g_verifyWorker = std::thread(VerifyWorker);
+	}
+
+	void WaitBackgroundVerify() {
+		std::unique_lock<std::mutex> lk(g_verifyMutex);
+		g_verifyCv.wait(lk, [] { return !g_verifyRunning; });
+		// スレッドの終了処理まで終わらせてから戻る
+		if (g_verifyWorker.joinable()) g_verifyWorker.join();
+	}
+}
@@ -0,0 +1,127 @@
+﻿#define NOMINMAX
+#include <windows.h>
+#include <emmintrin.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "SampleFormat.h"
+#include "EncoderProcess.h"
+
+namespace AudioEnc {
+
+	FetchFormat NegotiateFetchFormat(const std::string& ext, int bits, int in_rate, int out_rate, bool lossyPcm16) {
+		if (in_rate != out_rate) return FetchFormat::Float;
+		if (ext == ".mp3" || ext == ".opus") return lossyPcm16 ? FetchFormat::Pcm16 : FetchFormat::Float;
+		if ((ext == ".flac" || ext == ".wav") && bits == 16) return FetchFormat::Pcm16;
+		return FetchFormat::Float;
+	}
+
+	std::string FfmpegInputArgs(FetchFormat f, int rate, int channels) {
+		std::string fmt = (f == FetchFormat::Pcm16) ? "-f s16le -sample_fmt s16" : "-f f32le -sample_fmt flt";
+		return fmt + " -ar " + std::to_string(rate) + " -ac " + std::to_string(channels);
+	}
+
+	void Pcm16ToFloat(const int16_t* src, float* dst, size_t count) {
+		const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+			// 符号拡張: 上位16bitに置いてから算術シフト
+			__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+			__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+			_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+			_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+		}
+		for (; i < count; i++) dst[i] = src[i] * (1.0f / 32768.0f);
+	}
+
+	void FloatToPcm16(const float* src, int16_t* dst, size_t count) {
+		// 範囲外を float のうちに抑えてから変換する (cvtps2dq は範囲外を INT_MIN にするため)
+		const __m128 scale = _mm_set1_ps(32768.0f);
+		const __m128 lo = _mm_set1_ps(-32768.0f);
+		const __m128 hi = _mm_set1_ps(32767.0f);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), lo), hi);
+			__m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale), lo), hi);
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+		}
+		for (; i < count; i++) {
+			dst[i] = (int16_t)std::clamp<long>(lrintf(src[i] * 32768.0f), -32768, 32767);
+		}
+	}
+
+	namespace {
+		using Clock = std::chrono::steady_clock;
+
+		// 先頭 frames サンプルを format で取得して dst にコピーし、取得にかかった時間を返す
+		double FetchAll(const FetchFunc& fetch, FetchFormat f, int frames, int channels, uint8_t* dst) {
+			constexpr int CHUNK = 4096;
+			const size_t frameBytes = (size_t)channels * BytesPerSample(f);
+			double sec = 0.0;
+			for (int i = 0; i < frames; i += CHUNK) {
+				int r = 0;
+				int n = std::min(CHUNK, frames - i);
+				auto t0 = Clock::now();
+				const void* buf = fetch(i, n, &r, HostFormatId(f));
+				sec += std::chrono::duration<double>(Clock::now() - t0).count();
+				r = std::clamp(r, 0, n);
+				if (buf) memcpy(dst + i * frameBytes, buf, r * frameBytes);
+				if (r < n) memset(dst + (i + r) * frameBytes, 0, (n - r) * frameBytes);
+			}
+			return sec;
+		}
+
+		double EncodeNull(FetchFormat f, const void* data, size_t bytes, int rate, int channels, int out_rate, const std::string& codecArgs) {
+			std::string cmd = "ffmpeg -v error -threads 0 -y " + FfmpegInputArgs(f, rate, channels) +
+				" -i - -ar " + std::to_string(out_rate) + " " + codecArgs + " -f null -";
+			EncoderProcess enc;
+			if (!enc.Start(std::wstring(cmd.begin(), cmd.end()), false)) return -1.0;
+			enc.Write(data, bytes);
+			if (enc.Wait() != 0 || enc.Broken()) return -1.0;
+			return enc.Seconds();
+		}
+	}
+
+	FetchBenchResult RunFetchBenchmark(const FetchFunc& fetch, int frames, int rate, int channels, int out_rate,
+		const std::string& codecArgs) {
+		FetchBenchResult res;
+		res.frames = frames;
+		if (frames <= 0 || channels <= 0) return res;
+
+		const size_t count = (size_t)frames * channels;
+		// 一度きりの大きなバッファなので出力の予算 (プール) は使わない
+		std::vector<float> f32(count);
+		std::vector<int16_t> s16(count);
+		res.bytes[0] = count * sizeof(float);
+		res.bytes[1] = count * sizeof(int16_t);
+
+		res.fetch_seconds[0] = res.fetch_seconds[1] = 1e30;
+		for (int pass = 0; pass < 2; pass++) {
+			res.fetch_seconds[0] = std::min(res.fetch_seconds[0], FetchAll(fetch, FetchFormat::Float, frames, channels, (uint8_t*)f32.data()));
+			res.fetch_seconds[1] = std::min(res.fetch_seconds[1], FetchAll(fetch, FetchFormat::Pcm16, frames, channels, (uint8_t*)s16.data()));
+		}
+
+		// float 取得を基準に PCM16 取得の誤差を測る
+		const float* a = f32.data();
+		const int16_t* b = s16.data();
+		double signal = 0.0, noise = 0.0;
+		for (size_t i = 0; i < count; i++) {
+			double ref = a[i];
+			double err = b[i] / 32768.0 - ref;
+			signal += ref * ref;
+			noise += err * err;
+			res.max_error = std::max(res.max_error, std::fabs(err));
+			if (std::fabs(ref) > 1.0) res.clipped++;
+		}
+		res.snr_db = (noise > 0.0) ? 10.0 * std::log10(std::max(signal, 1e-30) / noise) : 999.0;
+
+		res.encode_seconds[0] = EncodeNull(FetchFormat::Float, a, res.bytes[0], rate, channels, out_rate, codecArgs);
+		res.encode_seconds[1] = EncodeNull(FetchFormat::Pcm16, b, res.bytes[1], rate, channels, out_rate, codecArgs);
+		res.ok = res.encode_seconds[0] >= 0.0 && res.encode_seconds[1] >= 0.0;
+		return res;
+	}
+}
@@ -0,0 +1,208 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <cwchar>
+#include <fstream>
+
+#include "TrackSplitter.h"
+#include "JsonText.h"
+
+namespace AudioEnc {
+
+	TrackSplitter TrackSplitter::FromRanges(int channels, std::vector<SampleRange> ranges) {
+		TrackSplitter t(channels);
+		t.by_ranges_ = true;
+		t.ranges_ = std::move(ranges);
+		return t;
+	}
+
+	TrackSplitter TrackSplitter::FromSilence(int rate, int channels, int min_gap_ms, int silence_db) {
+		TrackSplitter t(channels);
+		t.silence_level_ = (float)std::pow(10.0, silence_db / 20.0);
+		t.min_gap_ = std::max<int64_t>(1, (int64_t)rate * min_gap_ms / 1000);
+		t.lead_ = t.min_gap_ / 2;
+		return t;
+	}
+
+	void TrackSplitter::Feed(const float* data, int frames, const WriteFunc& write, const EndFunc& end) {
+		if (frames <= 0) return;
+		if (by_ranges_) FeedRanges(data, frames, write, end);
+		else FeedSilence(data, frames, write, end);
+		pos_ += frames;
+	}
+
+	void TrackSplitter::Finish(const WriteFunc& write, const EndFunc& end) {
+		if (!by_ranges_) {
+			// 末尾の無音は最後のトラックに含める
+			FlushHeld((int64_t)(held_.size() / channels_), write);
+			run_ = 0;
+		}
+		if ((int)tracks_.size() > track_) {
+			end(track_);
+			track_++;
+		}
+	}
+
+	void TrackSplitter::FeedRanges(const float* data, int frames, const WriteFunc& write, const EndFunc& end) {
+		const int64_t chunkEnd = pos_ + frames;
+		while (track_ < (int)ranges_.size()) {
+			const auto& r = ranges_[track_];
+			if (r.start >= chunkEnd) break;
+			int64_t s = std::max(r.start, pos_);
+			int64_t e = std::min(r.end, chunkEnd);
+			if (s < e) {
+				if ((int)tracks_.size() <= track_) tracks_.push_back({ s, s });
+				write(track_, data + (size_t)(s - pos_) * channels_, (int)(e - s));
+				tracks_[track_].end = e;
+			}
+			if (r.end > chunkEnd) break;
+			if ((int)tracks_.size() > track_) end(track_);
+			track_++;
+		}
+	}
+
+	/// <summary>
+	/// 無音検出による振り分け
+	/// </summary>
+	/// <description>
+	/// 有音部分はホストのバッファから直接書き込み、無音が続いている間だけ held_ にコピーして保留する。
+	/// 無音が終わった時点で長さが min_gap_ 以上なら、保留分の末尾 lead_ サンプルを次のトラックの頭にして区切る。
+	/// </description>
+	void TrackSplitter::FeedSilence(const float* data, int frames, const WriteFunc& write, const EndFunc& end) {
+		const int ch = channels_;
+		int span = 0;  // まだ書き込んでいない有音区間の先頭
+		for (int f = 0; f < frames; f++) {
+			const float* s = data + (size_t)f * ch;
+			float m = 0.0f;
+			for (int c = 0; c < ch; c++) m = std::max(m, std::fabs(s[c]));
+
+			if (m < silence_level_) {
+				if (run_ == 0 && f > span) WriteTrack(data + (size_t)span * ch, f - span, write);
+				held_.insert(held_.end(), s, s + ch);
+				run_++;
+				// 長い無音で保留が膨らまないように、区切りに使わない前半は先に書き出す
+				int64_t heldFrames = (int64_t)(held_.size() / ch);
+				if (heldFrames > lead_ * 2 + 4096) FlushHeld(heldFrames - lead_, write);
+				span = f + 1;
+			}
+			else {
+				if (run_ > 0) EndRun(write, end);
+				track_has_audio_ = true;
+			}
+		}
+		if (frames > span) WriteTrack(data + (size_t)span * ch, frames - span, write);
+	}
+
+	void TrackSplitter::EndRun(const WriteFunc& write, const EndFunc& end) {
+		int64_t heldFrames = (int64_t)(held_.size() / channels_);
+		if (run_ >= min_gap_ && track_has_audio_) {
+			FlushHeld(heldFrames - std::min(heldFrames, lead_), write);
+			end(track_);
+			track_++;
+			track_has_audio_ = false;
+		}
+		FlushHeld((int64_t)(held_.size() / channels_), write);
+		run_ = 0;
+	}
+
+	void TrackSplitter::FlushHeld(int64_t frames, const WriteFunc& write) {
+		if (frames <= 0) return;
+		WriteTrack(held_.data(), (int)frames, write);
+		held_.erase(held_.begin(), held_.begin() + (size_t)frames * channels_);
+	}
+
+	void TrackSplitter::WriteTrack(const float* data, int frames, const WriteFunc& write) {
+		if (frames <= 0) return;
+		if ((int)tracks_.size() <= track_) tracks_.push_back({ out_pos_, out_pos_ });
+		write(track_, data, frames);
+		out_pos_ += frames;
+		tracks_[track_].end = out_pos_;
+	}
+
+	std::vector<SampleRange> ParseSampleRanges(const std::wstring& text, int64_t total) {
+		std::vector<SampleRange> ranges;
+		size_t begin = 0;
+		while (begin < text.size()) {
+			size_t comma = text.find(L',', begin);
+			if (comma == std::wstring::npos) comma = text.size();
+			std::wstring item = text.substr(begin, comma - begin);
+			begin = comma + 1;
+
+			wchar_t* next = nullptr;
+			SampleRange r;
+			r.start = wcstoll(item.c_str(), &next, 10);
+			if (next == item.c_str()) continue;
+			while (*next == L' ') next++;
+			if (*next != L'-') continue;
+			next++;
+			wchar_t* last = nullptr;
+			r.end = wcstoll(next, &last, 10);
+			if (last == next) r.end = total;
+
+			r.start = std::clamp<int64_t>(r.start, 0, total);
+			r.end = std::clamp<int64_t>(r.end, 0, total);
+			if (r.start < r.end) ranges.push_back(r);
+		}
+
+		// 重なっている部分は前の範囲を優先する
+		std::sort(ranges.begin(), ranges.end(), [](const SampleRange& a, const SampleRange& b) { return a.start < b.start; });
+		std::vector<SampleRange> result;
+		for (auto r : ranges) {
+			if (!result.empty()) r.start = std::max(r.start, result.back().end);
+			if (r.start < r.end) result.push_back(r);
+		}
+		return result;
+	}
+
+	std::filesystem::path TrackFilePath(const std::filesystem::path& savefile, int track) {
+		wchar_t num[16];
+		swprintf(num, 16, L"_%02d", track + 1);
+		std::filesystem::path p = savefile.parent_path() / savefile.stem();
+		p += num;
+		p += savefile.extension();
+		return p;
+	}
+
+	bool WriteCueSheet(const std::filesystem::path& path, const std::vector<TrackInfo>& tracks) {
+		std::string s = "TITLE \"" + PathToUtf8(path.stem()) + "\"\r\n";
+		for (size_t i = 0; i < tracks.size(); i++) {
+			std::string ext = PathToUtf8(tracks[i].file.extension());
+			std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+			char num[8];
+			snprintf(num, sizeof(num), "%02d", (int)i + 1);
+
+			s += "FILE \"" + PathToUtf8(tracks[i].file.filename()) + "\"";
+			s += (ext == ".mp3") ? " MP3\r\n" : " WAVE\r\n";
+			s += std::string("  TRACK ") + num + " AUDIO\r\n";
+			s += std::string("    TITLE \"Track ") + num + "\"\r\n";
+			s += "    INDEX 01 00:00:00\r\n";
+		}
+
+		std::ofstream f(path, std::ios::binary | std::ios::trunc);
+		if (!f) return false;
+		f.write(s.data(), (std::streamsize)s.size());
+		return (bool)f;
+	}
+
+	bool WriteTrackManifest(const std::filesystem::path& path, int rate, const std::vector<TrackInfo>& tracks) {
+		std::string s = "{\n  \"rate\": ";
+		AppendJsonNumber(s, (int64_t)rate);
+		s += ",\n  \"tracks\": [";
+		for (size_t i = 0; i < tracks.size(); i++) {
+			const auto& t = tracks[i];
+			s += (i == 0) ? "\n    {" : ",\n    {";
+			s += "\"index\": "; AppendJsonNumber(s, (int64_t)i + 1);
+			s += ", \"file\": "; AppendJsonString(s, PathToUtf8(t.file.filename()));
+			s += ", \"start\": "; AppendJsonNumber(s, t.start);
+			s += ", \"end\": "; AppendJsonNumber(s, t.end);
+			s += ", \"frames\": "; AppendJsonNumber(s, t.end - t.start);
+			s += ", \"start_sec\": "; AppendJsonNumber(s, (double)t.start / rate);
+			s += "}";
+		}
+		s += "\n  ]\n}\n";
+
+		std::ofstream f(path, std::ios::binary | std::ios::trunc);
+		if (!f) return false;
+		f.write(s.data(), (std::streamsize)s.size());
+		return (bool)f;
+	}
+}
@@ -0,0 +1,319 @@
+﻿// ジャーナル (AudioEnc.journal.jsonl) を集計して、スループットの推移とバージョン間の回帰を表示する
+//
+// 使い方: JournalQuery <ジャーナル> [--by version|day|format] [--format .flac] [--threshold 10]
+//   ローテーションされた古いファイル (<ジャーナル>.1, .2, ...) も古い順に読む。
+//   回帰 (同じ形式で前のバージョンより中央値の速度が threshold % 以上遅い) があれば終了コード 2 を返す。
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace {
+
+	// 必要な分だけの JSON の値
+	struct Value {
+		enum Type { Null, Bool, Number, String, Object, Array } type = Null;
+		bool b = false;
+		double num = 0.0;
+		std::string str;
+		std::vector<std::pair<std::string, Value>> items;
+
+		const Value* Find(const std::string& key) const {
+			for (auto& [k, v] : items) if (k == key) return &v;
+			return nullptr;
+		}
+		double Num(const std::string& key, double def = 0.0) const {
+			auto v = Find(key);
+			return (v && v->type == Number) ? v->num : def;
+		}
+		std::string Str(const std::string& key) const {
+			auto v = Find(key);
+			return (v && v->type == String) ? v->str : std::string();
+		}
+		bool Flag(const std::string& key) const {
+			auto v = Find(key);
+			return v && v->type == Bool && v->b;
+		}
+	};
+
+	class Parser {
+	public:
+		explicit Parser(const std::string& s) : s_(s) {}
+
+		bool Parse(Value& v) {
+			if (!ParseValue(v)) return false;
+			Skip();
+			return pos_ == s_.size();
+		}
+
+	private:
+		void Skip() {
+			while (pos_ < s_.size() && (s_[pos_] == ' ' || s_[pos_] == '\t' || s_[pos_] == '\r' || s_[pos_] == '\n')) pos_++;
+		}
+
+		bool Literal(const char* word) {
+			size_t n = strlen(word);
+			if (s_.compare(pos_, n, word) != 0) return false;
+			pos_ += n;
+			return true;
+		}
+
+		bool ParseString(std::string& out) {
+			if (pos_ >= s_.size() || s_[pos_] != '"') return false;
+			pos_++;
+			while (pos_ < s_.size()) {
+				char c = s_[pos_++];
+				if (c == '"') return true;
+				if (c != '\\') {
+					out += c;
+					continue;
+				}
+				if (pos_ >= s_.size()) return false;
+				char e = s_[pos_++];
+				if (e == 'u') {
+					// 書き出し側は制御文字しかエスケープしないので 1 バイトで足りる
+					if (pos_ + 4 > s_.size()) return false;
+					out += (char)strtol(s_.substr(pos_, 4).c_str(), nullptr, 16);
+					pos_ += 4;
+				}
+				else if (e == 'n') out += '\n';
+				else if (e == 't') out += '\t';
+				else out += e;
+			}
+			return false;
+		}
+
+		bool ParseValue(Value& v) {
+			Skip();
+			if (pos_ >= s_.size()) return false;
+			char c = s_[pos_];
+			if (c == '{' || c == '[') {
+				const bool object = (c == '{');
+				v.type = object ? Value::Object : Value::Array;
+				pos_++;
+				Skip();
+				if (pos_ < s_.size() && s_[pos_] == (object ? '}' : ']')) {
+					pos_++;
+					return true;
+				}
+				while (true) {
+					std::string key;
+					if (object) {
+						Skip();
+						if (!ParseString(key)) return false;
+						Skip();
+						if (pos_ >= s_.size() || s_[pos_++] != ':') return false;
+					}
+					Value item;
+					if (!ParseValue(item)) return false;
+					v.items.emplace_back(std::move(key), std::move(item));
+					Skip();
+					if (pos_ >= s_.size()) return false;
+					char d = s_[pos_++];
+					if (d == ',') continue;
+					return d == (object ? '}' : ']');
+				}
+			}
+			if (c == '"') {
+				v.type = Value::String;
+				return ParseString(v.str);
+			}
+			if (Literal("true")) { v.type = Value::Bool; v.b = true; return true; }
+			if (Literal("false")) { v.type = Value::Bool; return true; }
+			if (Literal("null")) return true;
+
+			char* end = nullptr;
+			v.num = strtod(s_.c_str() + pos_, &end);
+			if (end == s_.c_str() + pos_) return false;
+			v.type = Value::Number;
+			pos_ = end - s_.c_str();
+			return true;
+		}
+
+		const std::string& s_;
+		size_t pos_ = 0;
+	};
+
+	double Median(std::vector<double> v) {
+		if (v.empty()) return 0.0;
+		std::sort(v.begin(), v.end());
+		size_t m = v.size() / 2;
+		return (v.size() % 2) ? v[m] : (v[m - 1] + v[m]) / 2.0;
+	}
+
+	struct Group {
+		int count = 0;
+		int ok = 0;
+		int aborted = 0;
+		int failed = 0;
+		double audio_seconds = 0.0;
+		std::vector<double> speed;      // 実時間に対する倍率 (正常終了したもの)
+		std::vector<double> mbps;       // パイプへの転送速度
+		std::map<std::string, double> stages;
+		std::map<std::string, int> errors;
+	};
+
+	void Add(Group& g, const Value& r) {
+		g.count++;
+		if (r.Flag("aborted")) {
+			g.aborted++;
+			return;
+		}
+		if (!r.Flag("ok")) {
+			g.failed++;
+			std::string e = r.Str("error");
+			g.errors[e.empty() ? "exit " + std::to_string((long long)r.Num("exit_code", -1)) : e]++;
+			return;
+		}
+		g.ok++;
+		double rate = r.Num("audio_rate");
+		double wall = r.Num("wall_s");
+		double sec = rate > 0 ? r.Num("audio_n") / rate : 0.0;
+		g.audio_seconds += sec;
+		if (wall > 0.0) {
+			g.speed.push_back(sec / wall);
+			g.mbps.push_back(r.Num("pipe_bytes") / wall / 1048576.0);
+		}
+		if (auto st = r.Find("stages")) {
+			for (auto& [k, v] : st->items) g.stages[k] += v.num;
+		}
+	}
+
+	// 最も時間を使った段階とその割合
+	std::string Bottleneck(const Group& g) {
+		double total = 0.0;
+		std::pair<std::string, double> top;
+		for (auto& [k, v] : g.stages) {
+			total += v;
+			if (v > top.second) top = { k, v };
+		}
+		if (top.first.empty() || total <= 0.0) return "-";
+		char buf[64];
+		snprintf(buf, sizeof(buf), "%s %.0f%%", top.first.c_str(), top.second / total * 100.0);
+		return buf;
+	}
+
+	std::vector<std::filesystem::path> JournalFiles(const std::filesystem::path& path) {
+		std::vector<std::filesystem::path> files;
+		for (int n = 1;; n++) {
+			std::filesystem::path p = path;
+			p += "." + std::to_string(n);
+			if (!std::filesystem::exists(p)) break;
+			files.push_back(p);
+		}
+		std::reverse(files.begin(), files.end());
+		if (std::filesystem::exists(path)) files.push_back(path);
+		return files;
+	}
+
+	int Usage() {
+		fprintf(stderr, "使い方: JournalQuery <ジャーナル> [--by version|day|format] [--format .flac] [--threshold 10]\n");
+		return 1;
+	}
+}
+
+int main(int argc, char** argv) {
+#ifdef _WIN32
+	SetConsoleOutputCP(CP_UTF8);
+#endif
+	if (argc < 2) return Usage();
+
+	std::filesystem::path journal = argv[1];
+	std::string by = "version";
+	std::string onlyFormat;
+	double threshold = 10.0;
+	for (int i = 2; i < argc; i++) {
+		std::string a = argv[i];
+		if (a == "--by" && i + 1 < argc) by = argv[++i];
+		else if (a == "--format" && i + 1 < argc) onlyFormat = argv[++i];
+		else if (a == "--threshold" && i + 1 < argc) threshold = atof(argv[++i]);
+		else return Usage();
+	}
+	if (by != "version" && by != "day" && by != "format") return Usage();
+
+	// (グループ, 形式) 毎に集計する。グループは最初に現れた順に並べる
+	std::vector<std::string> order;
+	std::map<std::pair<std::string, std::string>, Group> groups;
+	std::vector<std::string> formats;
+	int records = 0;
+	int broken = 0;
+
+	auto files = JournalFiles(journal);
+	if (files.empty()) {
+		fprintf(stderr, "ジャーナルがありません: %s\n", argv[1]);
+		return 1;
+	}
+	for (auto& f : files) {
+		std::ifstream in(f, std::ios::binary);
+		std::string line;
+		while (std::getline(in, line)) {
+			if (line.empty() || line == "\r") continue;
+			Value r;
+			if (!Parser(line).Parse(r) || r.type != Value::Object) {
+				// 書き込み中に落ちた行など
+				broken++;
+				continue;
+			}
+			std::string format = r.Str("format");
+			if (!onlyFormat.empty() && format != onlyFormat) continue;
+			std::string key = (by == "day") ? r.Str("time").substr(0, 10) : (by == "format") ? format : r.Str("version");
+			if (std::find(order.begin(), order.end(), key) == order.end()) order.push_back(key);
+			if (std::find(formats.begin(), formats.end(), format) == formats.end()) formats.push_back(format);
+			Add(groups[{ key, by == "format" ? std::string() : format }], r);
+			records++;
+		}
+	}
+
+	if (by == "day") std::sort(order.begin(), order.end());
+
+	printf("%d 件 (読めない行 %d)\n\n", records, broken);
+	printf("%-20s %-6s %6s %6s %6s %6s %10s %10s %9s  %s\n",
+		by.c_str(), "形式", "件数", "成功", "中断", "失敗", "音声(時間)", "速度(倍)", "MB/s", "律速");
+	for (auto& key : order) {
+		for (auto& [k, g] : groups) {
+			if (k.first != key) continue;
+			printf("%-20s %-6s %6d %6d %6d %6d %10.2f %10.1f %9.1f  %s\n",
+				key.c_str(), k.second.c_str(), g.count, g.ok, g.aborted, g.failed,
+				g.audio_seconds / 3600.0, Median(g.speed), Median(g.mbps), Bottleneck(g).c_str());
+			for (auto& [e, n] : g.errors) printf("%28s失敗: %s (%d 件)\n", "", e.c_str(), n);
+		}
+	}
+
+	// 同じ形式について、前のバージョンより中央値の速度が落ちていれば回帰として報告する
+	bool regressed = false;
+	if (by == "version") {
+		printf("\n");
+		for (auto& format : formats) {
+			const Group* prev = nullptr;
+			std::string prevKey;
+			for (auto& key : order) {
+				auto it = groups.find({ key, format });
+				if (it == groups.end() || it->second.speed.empty()) continue;
+				if (prev) {
+					double a = Median(prev->speed);
+					double b = Median(it->second.speed);
+					double change = (a > 0.0) ? (b - a) / a * 100.0 : 0.0;
+					if (change <= -threshold) {
+						printf("回帰: %s %s → %s: %.1f倍速 → %.1f倍速 (%.0f%%)\n", format.c_str(), prevKey.c_str(), key.c_str(), a, b, change);
+						regressed = true;
+					}
+				}
+				prev = &it->second;
+				prevKey = key;
+			}
+		}
+		if (!regressed) printf("回帰はありません (しきい値 %.0f%%)\n", threshold);
+	}
+	return regressed ? 2 : 0;
+}
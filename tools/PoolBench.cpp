@@ -0,0 +1,220 @@
+﻿// BufferPool と new / std::vector の確保を、出力パイプラインと同じ使い方で比べるベンチマーク
+//
+// 使い方: PoolBench [繰り返し回数の倍率 (既定 1)]
+//   analyzer: 出力スレッドが 4096 サンプル分をコピーしてキューに積み、ワーカーが処理して返す (QC 解析)
+//   decoder : 1MB のバッファを確保して埋め、読み終わったら返す (検証のデコーダ出力)
+//   mixed   : 4KB..4MB のさまざまなサイズを確保・書き込み・返却する
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "BufferPool.h"
+
+using namespace AudioEnc;
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	double Seconds(Clock::time_point t0) {
+		return std::chrono::duration<double>(Clock::now() - t0).count();
+	}
+
+	// 出力スレッドからワーカーへ渡すキュー (上限付き)
+	template <class T>
+	class BoundedQueue {
+	public:
+		explicit BoundedQueue(size_t limit) : limit_(limit) {}
+
+		void Push(T v) {
+			std::unique_lock<std::mutex> lk(mutex_);
+			cv_.wait(lk, [&] { return q_.size() < limit_; });
+			q_.push_back(std::move(v));
+			cv_.notify_all();
+		}
+
+		bool Pop(T& v) {
+			std::unique_lock<std::mutex> lk(mutex_);
+			cv_.wait(lk, [&] { return closed_ || !q_.empty(); });
+			if (q_.empty()) return false;
+			v = std::move(q_.front());
+			q_.pop_front();
+			cv_.notify_all();
+			return true;
+		}
+
+		void Close() {
+			std::lock_guard<std::mutex> lk(mutex_);
+			closed_ = true;
+			cv_.notify_all();
+		}
+
+	private:
+		std::mutex mutex_;
+		std::condition_variable cv_;
+		std::deque<T> q_;
+		size_t limit_;
+		bool closed_ = false;
+	};
+
+	float Touch(const float* p, size_t n) {
+		float s = 0.0f;
+		for (size_t i = 0; i < n; i += 16) s += p[i];
+		return s;
+	}
+
+	volatile float g_sink;
+
+	// analyzer: vector の場合はキューの長さで、プールの場合は予算で出力側を待たせる
+	double AnalyzerVector(int chunks, const std::vector<float>& src) {
+		BoundedQueue<std::vector<float>> q(64);
+		auto t0 = Clock::now();
+		std::thread worker([&] {
+			std::vector<float> v;
+			while (q.Pop(v)) g_sink = Touch(v.data(), v.size());
+		});
+		for (int i = 0; i < chunks; i++) q.Push(std::vector<float>(src.begin(), src.end()));
+		q.Close();
+		worker.join();
+		return Seconds(t0);
+	}
+
+	double AnalyzerPool(int chunks, const std::vector<float>& src) {
+		ExportBudget budget(BufferPool::Instance(), src.size() * sizeof(float) * 64);
+		BoundedQueue<PooledBuffer> q(1 << 30);
+		auto t0 = Clock::now();
+		std::thread worker([&] {
+			PooledBuffer b;
+			while (q.Pop(b)) {
+				g_sink = Touch(b.As<float>(), src.size());
+				b.Release();
+			}
+		});
+		for (int i = 0; i < chunks; i++) {
+			PooledBuffer b = budget.Acquire(src.size() * sizeof(float));
+			memcpy(b.Data(), src.data(), src.size() * sizeof(float));
+			b.HandOff();
+			q.Push(std::move(b));
+		}
+		q.Close();
+		worker.join();
+		return Seconds(t0);
+	}
+
+	double DecoderVector(int n, size_t bytes) {
+		auto t0 = Clock::now();
+		for (int i = 0; i < n; i++) {
+			std::vector<uint8_t> v(bytes);
+			memset(v.data(), i, bytes);
+			g_sink = v[bytes / 2];
+		}
+		return Seconds(t0);
+	}
+
+	double DecoderNew(int n, size_t bytes) {
+		auto t0 = Clock::now();
+		for (int i = 0; i < n; i++) {
+			uint8_t* p = new uint8_t[bytes];
+			memset(p, i, bytes);
+			g_sink = p[bytes / 2];
+			delete[] p;
+		}
+		return Seconds(t0);
+	}
+
+	double DecoderPool(int n, size_t bytes) {
+		ExportBudget budget(BufferPool::Instance(), bytes * 4);
+		auto t0 = Clock::now();
+		for (int i = 0; i < n; i++) {
+			PooledBuffer b = budget.Acquire(bytes);
+			memset(b.Data(), i, bytes);
+			g_sink = b.As<uint8_t>()[bytes / 2];
+		}
+		return Seconds(t0);
+	}
+
+	std::vector<size_t> MixedSizes(int n) {
+		std::mt19937 rng(1);
+		std::uniform_int_distribution<int> shift(12, 22);
+		std::vector<size_t> sizes(n);
+		for (auto& s : sizes) s = (size_t)1 << shift(rng);
+		return sizes;
+	}
+
+	double MixedVector(const std::vector<size_t>& sizes) {
+		auto t0 = Clock::now();
+		std::deque<std::vector<uint8_t>> live;
+		for (size_t s : sizes) {
+			live.emplace_back(s);
+			memset(live.back().data(), 1, s);
+			if (live.size() > 8) live.pop_front();
+		}
+		return Seconds(t0);
+	}
+
+	double MixedPool(const std::vector<size_t>& sizes) {
+		ExportBudget budget(BufferPool::Instance(), (size_t)64 << 20);
+		auto t0 = Clock::now();
+		std::deque<PooledBuffer> live;
+		for (size_t s : sizes) {
+			live.push_back(budget.Acquire(s));
+			memset(live.back().Data(), 1, s);
+			if (live.size() > 8) live.pop_front();
+		}
+		return Seconds(t0);
+	}
+
+	void Report(const char* name, int n, const std::vector<std::pair<const char*, double>>& results) {
+		const double base = results.front().second;
+		for (auto& [label, sec] : results) {
+			printf("%-9s %-7s %10.0f ns/回  (%s 比 %.2f 倍)\n", name, label, sec / n * 1e9, results.front().first, base / sec);
+		}
+	}
+
+	// 各実装を交互に3回測って最も速い値を採る
+	double Best(const std::function<double()>& f) {
+		double best = 1e30;
+		for (int i = 0; i < 3; i++) best = std::min(best, f());
+		return best;
+	}
+}
+
+int main(int argc, char** argv) {
+	const int scale = (argc > 1) ? std::max(1, atoi(argv[1])) : 1;
+	BufferPool::Instance().Configure((size_t)256 << 20, false);
+
+	const std::vector<float> chunk(4096 * 2, 0.25f);    // 4096 サンプル, ステレオ
+	const int chunks = 100000 * scale;
+	Report("analyzer", chunks, {
+		{ "vector", Best([&] { return AnalyzerVector(chunks, chunk); }) },
+		{ "pool", Best([&] { return AnalyzerPool(chunks, chunk); }) },
+	});
+
+	const int decodes = 5000 * scale;
+	Report("decoder", decodes, {
+		{ "vector", Best([&] { return DecoderVector(decodes, 1 << 20); }) },
+		{ "new", Best([&] { return DecoderNew(decodes, 1 << 20); }) },
+		{ "pool", Best([&] { return DecoderPool(decodes, 1 << 20); }) },
+	});
+
+	const auto sizes = MixedSizes(20000 * scale);
+	Report("mixed", (int)sizes.size(), {
+		{ "vector", Best([&] { return MixedVector(sizes); }) },
+		{ "pool", Best([&] { return MixedPool(sizes); }) },
+	});
+
+	auto st = BufferPool::Instance().Stats();
+	printf("\npool: OS確保 %llu 回, 再利用 %llu 回, 待機 %llu 回, 予算外 %llu 回, ピーク確保 %.1f MB\n",
+		(unsigned long long)st.allocations, (unsigned long long)st.reuses, (unsigned long long)st.waits,
+		(unsigned long long)st.overflows, st.peak_reserved / 1048576.0);
+	return 0;
+}